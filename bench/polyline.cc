@@ -0,0 +1,62 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tyr/polyline.h"
+
+using namespace valhalla::tyr;
+
+namespace {
+
+  //a long wiggly shape like a cross country route, points a few meters to a few hundred meters apart
+  std::string synthetic_shape(size_t points) {
+    std::mt19937 generator(17);
+    std::uniform_int_distribution<int32_t> step(-2000, 2000);
+    std::vector<int32_t> coordinates;
+    coordinates.reserve(points * 2);
+    int32_t lat = 40744376, lon = -73990432;
+    for(size_t i = 0; i < points; ++i) {
+      lat += step(generator);
+      lon += step(generator) + 500;
+      coordinates.push_back(lat);
+      coordinates.push_back(lon);
+    }
+    return encode_polyline(coordinates);
+  }
+
+}
+
+int main(int argc, char** argv) {
+  size_t points = argc > 1 ? std::stoul(argv[1]) : 500000;
+  size_t iterations = argc > 2 ? std::stoul(argv[2]) : 20;
+  auto encoded = synthetic_shape(points);
+
+  //decode only
+  std::vector<int32_t> coordinates;
+  auto start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < iterations; ++i)
+    decode_polyline(encoded, coordinates);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "decode:  " << points << " points, " << encoded.size() << " bytes, " <<
+    (points * iterations) / seconds / 1e6 << " Mpoints/s, " <<
+    (encoded.size() * iterations) / seconds / 1e6 << " MB/s" << std::endl;
+
+  //decode and write geojson
+  size_t written = 0;
+  start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < iterations; ++i) {
+    std::ostringstream stream;
+    decode_polyline(encoded, coordinates);
+    write_geojson(coordinates, 0, points - 1, stream);
+    written += stream.str().size();
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "geojson: " << points << " points, " << written / iterations << " bytes, " <<
+    (points * iterations) / seconds / 1e6 << " Mpoints/s" << std::endl;
+
+  return EXIT_SUCCESS;
+}
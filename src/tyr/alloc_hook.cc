@@ -0,0 +1,51 @@
+#include <cstdlib>
+#include <new>
+
+#include "tyr/alloc_hook.h"
+
+namespace {
+
+  //this library is meant to be preloaded so we can use the initial exec model
+  //which makes these a plain offset from the thread pointer rather than a call
+  //to __tls_get_addr on every allocation. they are trivially initialized so they
+  //are safe to touch from inside operator new
+  __attribute__((tls_model("initial-exec"))) thread_local bool armed = false;
+  __attribute__((tls_model("initial-exec"))) thread_local uint64_t allocations = 0;
+
+}
+
+void* operator new(std::size_t size) {
+  if(armed)
+    ++allocations;
+  if(size == 0)
+    size = 1;
+  while(true) {
+    void* memory = std::malloc(size);
+    if(memory)
+      return memory;
+    auto handler = std::get_new_handler();
+    if(!handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+extern "C" {
+
+  void valhalla_tyr_alloc_hook_arm(bool enabled) {
+    armed = enabled;
+  }
+
+  uint64_t valhalla_tyr_alloc_hook_count() {
+    return allocations;
+  }
+
+}
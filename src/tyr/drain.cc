@@ -0,0 +1,177 @@
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <list>
+#include <signal.h>
+#include <pthread.h>
+
+#include <prime_server/http_protocol.hpp>
+using namespace prime_server;
+
+#include "tyr/drain.h"
+
+namespace {
+
+  sigset_t shutdown_signals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    return signals;
+  }
+
+}
+
+namespace valhalla {
+  namespace tyr {
+
+    void block_shutdown_signals() {
+      auto signals = shutdown_signals();
+      auto error = pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+      if(error)
+        throw std::runtime_error("Could not block shutdown signals: " + std::string(strerror(error)));
+    }
+
+    int wait_for_shutdown() {
+      auto signals = shutdown_signals();
+      int signal = 0;
+      int error;
+      //sigwait can be woken up early on some systems
+      while((error = sigwait(&signals, &signal)) == EINTR);
+      if(error)
+        throw std::runtime_error("Could not wait for shutdown signals: " + std::string(strerror(error)));
+      return signal;
+    }
+
+    intake_t::intake_t():closed(false) {
+    }
+
+    bool intake_t::admit(uint64_t id) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(closed)
+        return false;
+      admitted.insert(id);
+      return true;
+    }
+
+    void intake_t::finish(uint64_t id) {
+      std::lock_guard<std::mutex> lock(mutex);
+      admitted.erase(id);
+    }
+
+    size_t intake_t::in_flight() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return admitted.size();
+    }
+
+    bool intake_t::drain(const std::chrono::milliseconds& timeout) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+      }
+      auto deadline = std::chrono::steady_clock::now() + timeout;
+      while(in_flight()) {
+        if(std::chrono::steady_clock::now() >= deadline)
+          return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      return true;
+    }
+
+    bool intake_t::drain(const boost::property_tree::ptree& config) {
+      auto timeout = config.get<float>("tyr.service.drain.timeout", 30.f);
+      return drain(std::chrono::milliseconds(static_cast<int64_t>(timeout * 1000)));
+    }
+
+    gate_t::gate_t(const std::string& upstream_endpoint, const std::string& downstream_endpoint,
+      const std::string& loopback_endpoint, const std::string& server_loopback_endpoint,
+      intake_t& intake, const std::chrono::milliseconds& linger):
+      upstream(context, ZMQ_ROUTER), downstream(context, ZMQ_DEALER), loopback(context, ZMQ_SUB),
+      server_loopback(context, ZMQ_PUB), intake(intake), gating(!upstream_endpoint.empty()), stopping(false) {
+      //closing the sockets waits this long at most for what they still have to send
+      int milliseconds = static_cast<int>(linger.count());
+      for(auto* socket : {&upstream, &downstream, &loopback, &server_loopback})
+        socket->setsockopt(ZMQ_LINGER, &milliseconds, sizeof(milliseconds));
+      //the server sends us requests as if we were the first stage's proxy
+      if(gating) {
+        upstream.bind(upstream_endpoint.c_str());
+        downstream.connect(downstream_endpoint.c_str());
+      }
+      //the workers send their responses to us as if we were the server
+      loopback.setsockopt(ZMQ_SUBSCRIBE, "", 0);
+      loopback.bind(loopback_endpoint.c_str());
+      server_loopback.connect(server_loopback_endpoint.c_str());
+    }
+
+    void gate_t::pass() {
+      zmq::pollitem_t items[] = {
+        { static_cast<void*>(loopback), 0, ZMQ_POLLIN, 0 },
+        { static_cast<void*>(upstream), 0, ZMQ_POLLIN, 0 },
+      };
+      //wake up now and then to see if we've been stopped
+      while(!stopping) {
+        zmq::poll(items, gating ? 2 : 1, 100);
+        if(items[0].revents & ZMQ_POLLIN)
+          response();
+        if(gating && (items[1].revents & ZMQ_POLLIN))
+          request();
+      }
+      //closing the context blocks until everything we sent has gone or the linger is up
+      upstream.close();
+      downstream.close();
+      loopback.close();
+      server_loopback.close();
+      context.close();
+    }
+
+    void gate_t::stop() {
+      stopping = true;
+    }
+
+    void gate_t::request() {
+      //the requester's address, the request info and then the request itself
+      auto messages = upstream.recv_all(0);
+      if(messages.size() < 3 || messages.front().size() == 0)
+        return;
+      messages.pop_front();
+      if(messages.front().size() < sizeof(http_request_t::info_t))
+        return;
+      auto info = *static_cast<const http_request_t::info_t*>(messages.front().data());
+      if(intake.admit(info.id)) {
+        downstream.send_all(messages, 0);
+        return;
+      }
+
+      //we are shutting down so answer for the pipeline
+      http_response_t response(503, "Service Unavailable", "Shutting down");
+      response.from_info(info);
+      auto text = response.to_string();
+      std::list<zmq::message_t> reply;
+      reply.emplace_back(static_cast<const void*>(&info), sizeof(info));
+      reply.emplace_back(static_cast<const void*>(text.data()), text.size());
+      server_loopback.send_all(reply, 0);
+    }
+
+    void gate_t::response() {
+      //the request info and then the response
+      auto messages = loopback.recv_all(0);
+      if(messages.empty())
+        return;
+      bool has_info = messages.front().size() >= sizeof(http_request_t::info_t);
+      uint64_t id = has_info ? static_cast<const http_request_t::info_t*>(messages.front().data())->id : 0;
+      //its only finished once its on its way to the server
+      server_loopback.send_all(messages, 0);
+      if(has_info)
+        intake.finish(id);
+    }
+
+    std::chrono::milliseconds drain_grace(const boost::property_tree::ptree& config) {
+      auto grace = config.get<float>("tyr.service.drain.grace", 1.f);
+      return std::chrono::milliseconds(static_cast<int64_t>(grace * 1000));
+    }
+
+  }
+}
@@ -0,0 +1,176 @@
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <iterator>
+#include <thread>
+#include <boost/optional.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include <prime_server/http_protocol.hpp>
+using namespace prime_server;
+
+#include <valhalla/midgard/pointll.h>
+
+#include "tyr/lanes.h"
+
+namespace {
+
+  //the stages whose endpoints need to be unique to each lane
+  const std::vector<std::string> STAGES = { "loki", "thor", "odin", "tyr" };
+
+  //where the router hands requests to the threads which classify them
+  const std::string CLASSIFIERS_ENDPOINT = "inproc://tyr_router_classifiers";
+
+  //all of the workers in the lane read their endpoints out of the config so we give the
+  //lane its own copy of the config with its own proxies. they all share the loopback
+  //since the responses go back to the one http server
+  boost::property_tree::ptree lane_config(const boost::property_tree::ptree& config, const std::string& name) {
+    auto lane = config;
+    for(const auto& stage : STAGES) {
+      auto key = stage + ".service.proxy";
+      lane.put(key, config.get<std::string>(key) + "_" + name);
+    }
+    return lane;
+  }
+
+}
+
+namespace valhalla {
+  namespace tyr {
+
+    std::vector<lane_t> get_lanes(const boost::property_tree::ptree& config) {
+      std::vector<lane_t> lanes{{"default", 1.f, 0.f, 0, config}};
+      auto extra_lanes = config.get_child_optional("httpd.service.lanes");
+      if(!extra_lanes || extra_lanes->empty())
+        return lanes;
+
+      //with more than one lane every lane gets its own endpoints
+      for(const auto& lane : *extra_lanes) {
+        if(lane.first == lanes.front().name)
+          throw std::runtime_error("Lane name " + lane.first + " is reserved");
+        auto share = lane.second.get<float>("worker_share");
+        if(share <= 0.f || share >= 1.f)
+          throw std::runtime_error("Lane " + lane.first + " worker_share must be between 0 and 1");
+        lanes.push_back({lane.first, share, lane.second.get<float>("min_distance", 0.f), 0, lane_config(config, lane.first)});
+      }
+      lanes.front().config = lane_config(config, lanes.front().name);
+      return lanes;
+    }
+
+    void reserve_workers(std::vector<lane_t>& lanes, size_t worker_concurrency) {
+      if(worker_concurrency == 0)
+        throw std::runtime_error("Need at least one worker per stage");
+      size_t reserved = 0;
+      for(auto lane = std::next(lanes.begin()); lane != lanes.end(); ++lane) {
+        lane->workers = static_cast<size_t>(lane->worker_share * worker_concurrency + .5f);
+        reserved += lane->workers;
+      }
+      //the default lane has to keep one, take them back from the biggest lanes first
+      while(reserved >= worker_concurrency) {
+        auto biggest = std::next(lanes.begin());
+        for(auto lane = biggest; lane != lanes.end(); ++lane)
+          if(lane->workers > biggest->workers)
+            biggest = lane;
+        --biggest->workers;
+        --reserved;
+      }
+      lanes.front().workers = worker_concurrency - reserved;
+    }
+
+    size_t classify(const std::vector<lane_t>& lanes, const boost::property_tree::ptree& request) {
+      //they told us which one they want
+      auto priority = request.get_optional<std::string>("priority");
+      if(priority) {
+        for(size_t i = 0; i < lanes.size(); ++i)
+          if(lanes[i].name == *priority && lanes[i].workers)
+            return i;
+      }
+
+      //how far is it as the crow flies
+      float distance = 0.f;
+      auto locations = request.get_child_optional("locations");
+      if(locations) {
+        boost::optional<midgard::PointLL> previous;
+        for(const auto& location : *locations) {
+          midgard::PointLL ll(location.second.get<float>("lon"), location.second.get<float>("lat"));
+          if(previous)
+            distance += previous->Distance(ll);
+          previous = ll;
+        }
+      }
+
+      //the lane with the longest cutoff we reached
+      size_t best = 0;
+      for(size_t i = 1; i < lanes.size(); ++i) {
+        if(lanes[i].workers && lanes[i].min_distance > 0.f && distance >= lanes[i].min_distance &&
+           (best == 0 || lanes[i].min_distance > lanes[best].min_distance))
+          best = i;
+      }
+      return best;
+    }
+
+    size_t classify(const std::vector<lane_t>& lanes, const char* request, size_t size, size_t max_bytes) {
+      if(size > max_bytes)
+        return 0;
+      try {
+        //the request is either in the json query parameter or the body
+        auto http_request = http_request_t::from_string(request, size);
+        boost::property_tree::ptree request_pt;
+        auto json = http_request.query.find("json");
+        std::stringstream stream(json != http_request.query.end() && !json->second.empty() ? json->second.front() : http_request.body);
+        if(!stream.str().empty())
+          boost::property_tree::read_json(stream, request_pt);
+        auto priority = http_request.query.find("priority");
+        if(priority != http_request.query.end() && !priority->second.empty())
+          request_pt.put("priority", priority->second.front());
+        return classify(lanes, request_pt);
+      }
+      catch(const std::exception&) {
+        //we dont reject anything here, the first stage can tell them whats wrong
+        return 0;
+      }
+    }
+
+    router_t::router_t(zmq::context_t& context, const std::string& upstream_endpoint, const std::vector<lane_t>& lanes):
+      context(context), upstream(context, ZMQ_ROUTER), classifiers(context, ZMQ_DEALER), lanes(lanes),
+      threads(std::max(lanes.front().config.get<size_t>("httpd.service.router.threads", 2), size_t(1))),
+      max_bytes(lanes.front().config.get<size_t>("httpd.service.router.max_bytes", 65536)) {
+      //we take the place of the first stage's proxy as far as the server is concerned
+      upstream.bind(upstream_endpoint.c_str());
+      //inproc has to be bound before anything connects
+      classifiers.bind(CLASSIFIERS_ENDPOINT.c_str());
+    }
+
+    void router_t::route() {
+      for(size_t i = 0; i < threads; ++i) {
+        std::thread classifier(std::bind(&router_t::classify_jobs, this));
+        classifier.detach();
+      }
+      //pass requests round robin to the classifiers, this never returns
+      zmq::proxy(static_cast<void*>(upstream), static_cast<void*>(classifiers), nullptr);
+    }
+
+    void router_t::classify_jobs() {
+      zmq::socket_t jobs(context, ZMQ_DEALER);
+      jobs.connect(CLASSIFIERS_ENDPOINT.c_str());
+      //look like any other stage sending on to the proxy of each lane
+      std::list<zmq::socket_t> downstream;
+      for(const auto& lane : lanes) {
+        downstream.emplace_back(context, ZMQ_DEALER);
+        downstream.back().connect((lane.config.get<std::string>(STAGES.front() + ".service.proxy") + "_in").c_str());
+      }
+      while(true) {
+        //the requester's address, the request info and then the request itself
+        auto messages = jobs.recv_all(0);
+        if(messages.size() < 2)
+          continue;
+        messages.pop_front();
+        const auto& job = messages.back();
+        auto lane = classify(lanes, static_cast<const char*>(job.data()), job.size(), max_bytes);
+        std::next(downstream.begin(), lane)->send_all(messages, 0);
+      }
+    }
+
+  }
+}
@@ -0,0 +1,246 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <valhalla/midgard/logging.h>
+
+#include "tyr/listener.h"
+
+namespace {
+
+  //stop reading from one side when this much is waiting to go out the other
+  constexpr size_t MAX_BUFFERED = 1 << 16;
+
+  std::string error_string(const std::string& what) {
+    return what + ": " + std::string(strerror(errno));
+  }
+
+  void nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+
+  //false once the other end is done sending or something broke
+  bool receive(int fd, std::string& buffer) {
+    char bytes[MAX_BUFFERED];
+    auto received = recv(fd, bytes, sizeof(bytes), 0);
+    if(received > 0) {
+      buffer.append(bytes, received);
+      return true;
+    }
+    return received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+  }
+
+  //false if the other end is gone
+  bool send(int fd, std::string& buffer) {
+    auto sent = ::send(fd, buffer.data(), buffer.size(), MSG_NOSIGNAL);
+    if(sent >= 0) {
+      buffer.erase(0, sent);
+      return true;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+
+}
+
+namespace valhalla {
+  namespace tyr {
+
+    listener_t::listener_t(const std::string& endpoint, uint16_t backend_port):
+      listening(-1), backend_port(backend_port), closing(false), stopping(false) {
+      //tcp://host:port
+      auto colon = endpoint.rfind(':');
+      if(endpoint.find("tcp://") != 0 || colon == std::string::npos || colon < 6)
+        throw std::runtime_error("Can only share tcp://host:port endpoints, not " + endpoint);
+      auto host = endpoint.substr(6, colon - 6);
+      auto port = endpoint.substr(colon + 1);
+      if(host.size() > 1 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+
+      addrinfo hints{};
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      hints.ai_flags = AI_PASSIVE;
+      addrinfo* addresses = nullptr;
+      auto error = getaddrinfo(host == "*" ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+      if(error)
+        throw std::runtime_error("Could not resolve " + endpoint + ": " + gai_strerror(error));
+
+      //the first one we can listen on wins
+      std::string failure;
+      for(auto* address = addresses; address && listening == -1; address = address->ai_next) {
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if(fd == -1) {
+          failure = error_string("Could not create socket");
+          continue;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) ||
+           bind(fd, address->ai_addr, address->ai_addrlen) || listen(fd, SOMAXCONN)) {
+          failure = error_string("Could not listen on " + endpoint);
+          ::close(fd);
+          continue;
+        }
+        nonblocking(fd);
+        listening = fd;
+      }
+      freeaddrinfo(addresses);
+      if(listening == -1)
+        throw std::runtime_error(failure);
+    }
+
+    listener_t::~listener_t() {
+      if(listening != -1)
+        ::close(listening);
+      for(const auto& connection : connections) {
+        ::close(connection.client);
+        ::close(connection.backend);
+      }
+    }
+
+    void listener_t::pump() {
+      std::vector<pollfd> fds;
+      while(!stopping) {
+        if(closing && listening != -1)
+          close_listening();
+
+        //only ask about the directions that can make progress, poll skips negative fds
+        fds.clear();
+        fds.push_back({listening, POLLIN, 0});
+        for(const auto& connection : connections) {
+          short client = (connection.client_open && connection.to_backend.size() < MAX_BUFFERED ? POLLIN : 0) |
+            (connection.to_client.empty() ? 0 : POLLOUT);
+          short backend = (connection.backend_open && connection.to_client.size() < MAX_BUFFERED ? POLLIN : 0) |
+            (connection.to_backend.empty() ? 0 : POLLOUT);
+          fds.push_back({client ? connection.client : -1, client, 0});
+          fds.push_back({backend ? connection.backend : -1, backend, 0});
+        }
+        //wake up now and then to see if we've been stopped
+        if(poll(fds.data(), fds.size(), 100) <= 0)
+          continue;
+
+        auto fd = fds.begin() + 1;
+        for(auto connection = connections.begin(); connection != connections.end(); fd += 2) {
+          bool broken = false;
+          //read whatever came in
+          if((fd->revents & (POLLIN | POLLHUP | POLLERR)) && connection->client_open)
+            connection->client_open = receive(connection->client, connection->to_backend);
+          if(((fd + 1)->revents & (POLLIN | POLLHUP | POLLERR)) && connection->backend_open)
+            connection->backend_open = receive(connection->backend, connection->to_client);
+          //write out what we can
+          if(!connection->to_client.empty() && (fd->revents & (POLLOUT | POLLERR)))
+            broken |= !send(connection->client, connection->to_client);
+          if(!connection->to_backend.empty() && ((fd + 1)->revents & (POLLOUT | POLLERR)))
+            broken |= !send(connection->backend, connection->to_backend);
+          //pass along that one side is done sending once everything it sent is through
+          if(!connection->client_open && connection->to_backend.empty() && !connection->backend_shut) {
+            shutdown(connection->backend, SHUT_WR);
+            connection->backend_shut = true;
+          }
+          if(!connection->backend_open && connection->to_client.empty() && !connection->client_shut) {
+            shutdown(connection->client, SHUT_WR);
+            connection->client_shut = true;
+          }
+          //done when both sides are or when one of them went away
+          if(broken || (connection->client_shut && connection->backend_shut)) {
+            ::close(connection->client);
+            ::close(connection->backend);
+            connection = connections.erase(connection);
+          }
+          else
+            ++connection;
+        }
+
+        if(listening != -1 && (fds.front().revents & POLLIN))
+          accept();
+      }
+
+      //stopped, whatever is left is dropped
+      if(listening != -1)
+        close_listening();
+      for(const auto& connection : connections) {
+        ::close(connection.client);
+        ::close(connection.backend);
+      }
+      connections.clear();
+    }
+
+    void listener_t::close() {
+      closing = true;
+    }
+
+    void listener_t::stop() {
+      stopping = true;
+    }
+
+    void listener_t::accept() {
+      while(true) {
+        int client = ::accept(listening, nullptr, nullptr);
+        if(client == -1) {
+          if(errno == EINTR || errno == ECONNABORTED)
+            continue;
+          if(errno != EAGAIN && errno != EWOULDBLOCK)
+            LOG_WARN(error_string("Could not accept connection"));
+          return;
+        }
+        //the server is on the loopback so connecting doesnt keep us waiting
+        int backend = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(backend_port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(backend == -1 || connect(backend, reinterpret_cast<sockaddr*>(&address), sizeof(address))) {
+          LOG_ERROR(error_string("Could not connect to the http server"));
+          if(backend != -1)
+            ::close(backend);
+          ::close(client);
+          continue;
+        }
+        nonblocking(client);
+        nonblocking(backend);
+        connections.push_back({client, backend, true, true, false, false, "", ""});
+      }
+    }
+
+    void listener_t::close_listening() {
+      //connections still in the backlog would be reset when we close, so take them first.
+      //after that the kernel gives new ones to whoever else is listening on the port
+      accept();
+      ::close(listening);
+      listening = -1;
+    }
+
+    uint16_t listener_t::free_port() {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      if(fd == -1)
+        throw std::runtime_error(error_string("Could not create socket"));
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_port = 0;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t size = sizeof(address);
+      if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ||
+         getsockname(fd, reinterpret_cast<sockaddr*>(&address), &size)) {
+        auto error = error_string("Could not find a free port");
+        ::close(fd);
+        throw std::runtime_error(error);
+      }
+      ::close(fd);
+      return ntohs(address.sin_port);
+    }
+
+  }
+}
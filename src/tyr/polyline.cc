@@ -0,0 +1,116 @@
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+#include "tyr/polyline.h"
+
+namespace {
+
+  //writes a fixed point value as a decimal with 6 digits after the point
+  //this is exact, unlike going through a double, and much faster than iostreams
+  char* write_fixed(int32_t value, char* out) {
+    uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+    if(value < 0)
+      *out++ = '-';
+    uint32_t whole = magnitude / valhalla::tyr::POLYLINE_PRECISION;
+    uint32_t fraction = magnitude % valhalla::tyr::POLYLINE_PRECISION;
+    //any int32 has at most 4 whole digits at this precision
+    char digits[10];
+    char* digit = digits;
+    do {
+      *digit++ = '0' + whole % 10;
+      whole /= 10;
+    } while(whole);
+    while(digit != digits)
+      *out++ = *--digit;
+    *out++ = '.';
+    for(int i = 5; i >= 0; --i) {
+      out[i] = '0' + fraction % 10;
+      fraction /= 10;
+    }
+    return out + 6;
+  }
+
+}
+
+namespace valhalla {
+  namespace tyr {
+
+    void decode_polyline(const std::string& encoded, std::vector<int32_t>& coordinates) {
+      //every value takes at least one character so this is an upper bound
+      //and lets the hot loop write without any capacity checks
+      coordinates.resize(encoded.size());
+      int32_t* out = coordinates.data();
+      const unsigned char* in = reinterpret_cast<const unsigned char*>(encoded.data());
+      const unsigned char* end = in + encoded.size();
+      //accumulate wider than we store so hostile input cant overflow, we check the range as we go
+      int64_t previous[2] = {0, 0};
+      size_t axis = 0;
+      while(in < end) {
+        //each value is a zig zag encoded delta in 5 bit chunks with a continuation bit
+        uint64_t value = 0;
+        uint32_t shift = 0;
+        uint32_t chunk;
+        do {
+          if(in == end || shift > 30)
+            throw std::runtime_error("Malformed polyline");
+          chunk = static_cast<uint32_t>(*in++) - 63;
+          value |= static_cast<uint64_t>(chunk & 0x1f) << shift;
+          shift += 5;
+        } while(chunk >= 0x20);
+        //undo the zig zag without branching and add the delta
+        previous[axis] += static_cast<int64_t>((value >> 1) ^ (0ull - (value & 1)));
+        if(previous[axis] < std::numeric_limits<int32_t>::min() || previous[axis] > std::numeric_limits<int32_t>::max())
+          throw std::runtime_error("Polyline coordinate out of range");
+        *out++ = static_cast<int32_t>(previous[axis]);
+        axis ^= 1;
+      }
+      if(axis)
+        throw std::runtime_error("Malformed polyline");
+      coordinates.resize(out - coordinates.data());
+    }
+
+    std::string encode_polyline(const std::vector<int32_t>& coordinates) {
+      std::string encoded;
+      encoded.reserve(coordinates.size() * 4);
+      int64_t previous[2] = {0, 0};
+      for(size_t i = 0; i < coordinates.size(); ++i) {
+        //deltas between int32s need 33 bits
+        int64_t delta = coordinates[i] - previous[i & 1];
+        previous[i & 1] = coordinates[i];
+        uint64_t value = delta < 0 ? ~(static_cast<uint64_t>(delta) << 1) : static_cast<uint64_t>(delta) << 1;
+        while(value >= 0x20) {
+          encoded.push_back(static_cast<char>((0x20 | (value & 0x1f)) + 63));
+          value >>= 5;
+        }
+        encoded.push_back(static_cast<char>(value + 63));
+      }
+      return encoded;
+    }
+
+    void write_geojson(const std::vector<int32_t>& coordinates, size_t begin, size_t end, std::ostream& stream) {
+      static const char head[] = "{\"type\":\"LineString\",\"coordinates\":[";
+      size_t points = coordinates.size() / 2;
+      end = std::min(end, points ? points - 1 : 0);
+      //each point is at most 2 * (sign + 4 digits + point + 6 digits) plus 4 punctuation
+      std::string buffer(sizeof(head) + 2 + (end - std::min(begin, end) + 1) * 28, '\0');
+      char* out = &buffer[0];
+      std::copy(head, head + sizeof(head) - 1, out);
+      out += sizeof(head) - 1;
+      for(size_t i = begin; points && i <= end; ++i) {
+        if(i != begin)
+          *out++ = ',';
+        //geojson is lon,lat
+        *out++ = '[';
+        out = write_fixed(coordinates[i * 2 + 1], out);
+        *out++ = ',';
+        out = write_fixed(coordinates[i * 2], out);
+        *out++ = ']';
+      }
+      *out++ = ']';
+      *out++ = '}';
+      stream.write(buffer.data(), out - buffer.data());
+    }
+
+  }
+}
@@ -0,0 +1,257 @@
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "tyr/profiler.h"
+
+namespace {
+
+  const char* PHASE_NAMES[] = { "parse", "serialize", "response" };
+
+  std::string summarize(const std::array<valhalla::tyr::aggregate_t, valhalla::tyr::PHASE_COUNT>& aggregates,
+    bool hardware, bool allocations) {
+    std::ostringstream stream;
+    for(size_t i = 0; i < aggregates.size(); ++i) {
+      const auto& aggregate = aggregates[i];
+      if(i > 0)
+        stream << " | ";
+      //averages per request are easier to compare across dumps
+      auto count = aggregate.count ? aggregate.count : 1;
+      stream << PHASE_NAMES[i] << ": requests=" << aggregate.count <<
+        " avg_ns=" << aggregate.total.nanoseconds / count;
+      if(allocations)
+        stream << " avg_allocations=" << aggregate.total.allocations / count;
+      if(hardware) {
+        //only over the requests the counters were scheduled for, the rest have nothing to add
+        auto counted = aggregate.counted ? aggregate.counted : 1;
+        stream << " counted=" << aggregate.counted <<
+          " avg_cycles=" << aggregate.total.cycles / counted <<
+          " avg_instructions=" << aggregate.total.instructions / counted <<
+          " avg_cache_misses=" << aggregate.total.cache_misses / counted <<
+          " avg_branch_misses=" << aggregate.total.branch_misses / counted;
+        if(aggregate.total.cycles)
+          stream << " ipc=" << static_cast<double>(aggregate.total.instructions) / aggregate.total.cycles;
+      }
+      else
+        stream << " (hardware counters unavailable)";
+    }
+    return stream.str();
+  }
+
+#ifdef __linux__
+  //the hardware events we want, in the order they are stored
+  const uint64_t EVENTS[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+
+  int open_event(uint64_t config, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    //only count this thread in user space, that way we dont need privileges
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    //the group is scheduled on the pmu as a unit so all counts share a time base, and
+    //we get enabled/running times to scale by when the pmu is multiplexing events
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+  }
+#endif
+
+}
+
+namespace valhalla {
+  namespace tyr {
+
+    sample_t& sample_t::operator+=(const sample_t& other) {
+      cycles += other.cycles;
+      instructions += other.instructions;
+      cache_misses += other.cache_misses;
+      branch_misses += other.branch_misses;
+      allocations += other.allocations;
+      nanoseconds += other.nanoseconds;
+      return *this;
+    }
+
+    profiler_t::profiler_t(): opened(false), arm_hook(nullptr), hook_count(nullptr), running(false), fds{{-1, -1, -1, -1}},
+      slots{{-1, -1, -1, -1}}, leader(-1), current(phase_t::PARSE), counters_start{}, allocations_start(0), last{} {
+      reset();
+    }
+
+    profiler_t::~profiler_t() {
+      for(auto fd : fds)
+        if(fd != -1)
+          close(fd);
+    }
+
+    void profiler_t::open() {
+      opened = true;
+      //the alloc hook is opt in, if its been preloaded we'll find it
+      arm_hook = reinterpret_cast<void (*)(bool)>(dlsym(RTLD_DEFAULT, "valhalla_tyr_alloc_hook_arm"));
+      hook_count = reinterpret_cast<uint64_t (*)()>(dlsym(RTLD_DEFAULT, "valhalla_tyr_alloc_hook_count"));
+      if(!arm_hook || !hook_count) {
+        arm_hook = nullptr;
+        hook_count = nullptr;
+      }
+#ifdef __linux__
+      //the first event that opens leads the group, events that arent supported
+      //are left out so we can still get the others
+      int slot = 0;
+      for(size_t i = 0; i < fds.size(); ++i) {
+        fds[i] = open_event(EVENTS[i], leader);
+        if(fds[i] == -1)
+          continue;
+        if(leader == -1)
+          leader = fds[i];
+        slots[i] = slot++;
+      }
+#endif
+    }
+
+    void profiler_t::read(counters_t& counters) const {
+      counters = counters_t{};
+      if(leader == -1)
+        return;
+      //the group read is: nr, time_enabled, time_running, value[nr]
+      uint64_t buffer[3 + 4];
+      auto bytes = ::read(leader, buffer, sizeof(buffer));
+      if(bytes < static_cast<ssize_t>(3 * sizeof(uint64_t)) || bytes < static_cast<ssize_t>((3 + buffer[0]) * sizeof(uint64_t)))
+        return;
+      counters.enabled = buffer[1];
+      counters.running = buffer[2];
+      for(size_t i = 0; i < slots.size(); ++i)
+        if(slots[i] != -1)
+          counters.values[i] = buffer[3 + slots[i]];
+    }
+
+    uint64_t profiler_t::allocations() const {
+      return hook_count ? hook_count() : 0;
+    }
+
+    bool profiler_t::allocations_available() const {
+      return hook_count != nullptr;
+    }
+
+    bool profiler_t::hardware_available() const {
+      return leader != -1;
+    }
+
+    void profiler_t::begin(phase_t phase) {
+      //the events have to be opened on the thread we are measuring
+      if(!opened)
+        open();
+      current = phase;
+      running = true;
+      if(arm_hook)
+        arm_hook(true);
+      allocations_start = allocations();
+      read(counters_start);
+      time_start = std::chrono::steady_clock::now();
+    }
+
+    const sample_t& profiler_t::end() {
+      auto time_end = std::chrono::steady_clock::now();
+      counters_t counters_end;
+      read(counters_end);
+      if(arm_hook)
+        arm_hook(false);
+      running = false;
+
+      //if the pmu was shared with other events during the phase the group only counted for
+      //part of the time, so we extrapolate. all events in the group get the same scale
+      std::array<uint64_t, 4> deltas;
+      auto enabled = counters_end.enabled - counters_start.enabled;
+      auto on_pmu = counters_end.running - counters_start.running;
+      for(size_t i = 0; i < deltas.size(); ++i) {
+        auto delta = counters_end.values[i] - counters_start.values[i];
+        deltas[i] = on_pmu ? static_cast<uint64_t>(static_cast<double>(delta) * enabled / on_pmu) : 0;
+      }
+      last.cycles = deltas[0];
+      last.instructions = deltas[1];
+      last.cache_misses = deltas[2];
+      last.branch_misses = deltas[3];
+      last.allocations = allocations() - allocations_start;
+      last.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(time_end - time_start).count();
+
+      //when the group never made it onto the pmu there is nothing to scale so
+      //we leave the counters out of the totals rather than dragging them down
+      auto& aggregate = aggregates[static_cast<size_t>(current)];
+      ++aggregate.count;
+      if(on_pmu)
+        ++aggregate.counted;
+      aggregate.total += last;
+      return last;
+    }
+
+    void profiler_t::cancel() {
+      if(arm_hook)
+        arm_hook(false);
+      running = false;
+    }
+
+    bool profiler_t::measuring() const {
+      return running;
+    }
+
+    const aggregate_t& profiler_t::aggregate(phase_t phase) const {
+      return aggregates[static_cast<size_t>(phase)];
+    }
+
+    void profiler_t::reset() {
+      for(auto& aggregate : aggregates)
+        aggregate = aggregate_t{};
+    }
+
+    std::string profiler_t::summary() const {
+      return summarize(aggregates, hardware_available(), allocations_available());
+    }
+
+    profile_totals_t::profile_totals_t(): hardware(false), allocations(false),
+      last_summary(std::chrono::steady_clock::now()) {
+      for(auto& aggregate : aggregates)
+        aggregate = aggregate_t{};
+    }
+
+    void profile_totals_t::merge(profiler_t& profiler) {
+      std::lock_guard<std::mutex> lock(mutex);
+      for(size_t i = 0; i < aggregates.size(); ++i) {
+        const auto& other = profiler.aggregate(static_cast<phase_t>(i));
+        aggregates[i].count += other.count;
+        aggregates[i].counted += other.counted;
+        aggregates[i].total += other.total;
+      }
+      hardware = hardware || profiler.hardware_available();
+      allocations = allocations || profiler.allocations_available();
+      profiler.reset();
+    }
+
+    aggregate_t profile_totals_t::aggregate(phase_t phase) {
+      std::lock_guard<std::mutex> lock(mutex);
+      return aggregates[static_cast<size_t>(phase)];
+    }
+
+    std::string profile_totals_t::summary(const std::chrono::steady_clock::duration& interval) {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto now = std::chrono::steady_clock::now();
+      if(now - last_summary < interval)
+        return "";
+      auto summary = summarize(aggregates, hardware, allocations);
+      for(auto& aggregate : aggregates)
+        aggregate = aggregate_t{};
+      last_summary = now;
+      return summary;
+    }
+
+  }
+}
@@ -0,0 +1,533 @@
+#include <functional>
+#include <string>
+#include <vector>
+#include <list>
+#include <utility>
+#include <unordered_map>
+#include <cstdint>
+#include <sstream>
+#include <boost/variant.hpp>
+
+#include <valhalla/baldr/json.h>
+
+#include "tyr/serializers.h"
+#include "tyr/polyline.h"
+
+using namespace valhalla;
+using namespace valhalla::baldr;
+using namespace valhalla::odin;
+using namespace std;
+
+namespace {
+
+  //something which writes itself straight into the output
+  using streamed_t = std::function<void (std::ostream&)>;
+
+  /**
+   * A json object streamed straight to the output. The members are regular json values
+   * and get serialized as usual. Anything else (geometry, or objects which contain it) is
+   * a function which writes itself into the stream after them, so we never build up
+   * json values for every coordinate or copy the output around. Only used for geojson,
+   * when the shape is a polyline the whole response is plain json.
+   */
+  struct object_t {
+    json::MapPtr members;
+    std::list<std::pair<std::string, streamed_t> > streamed;
+  };
+
+  std::ostream& operator<<(std::ostream& stream, const object_t& object) {
+    //the regular members, written the same way a json map writes them
+    stream << '{';
+    bool separator = false;
+    for(const auto& member : *object.members) {
+      if(separator)
+        stream << ',';
+      separator = true;
+      stream << '"' << member.first << "\":";
+      boost::apply_visitor(json::OstreamVisitor(stream), member.second);
+    }
+    //then the ones which write themselves
+    for(const auto& member : object.streamed) {
+      if(separator)
+        stream << ',';
+      separator = true;
+      stream << '"' << member.first << "\":";
+      member.second(stream);
+    }
+    return stream << '}';
+  }
+
+  //a json array of things which stream themselves
+  template <class T>
+  streamed_t streamed_array(const std::vector<T>& items) {
+    return [items](std::ostream& stream) {
+      stream << '[';
+      for(auto item = items.cbegin(); item != items.cend(); ++item) {
+        if(item != items.cbegin())
+          stream << ',';
+        stream << *item;
+      }
+      stream << ']';
+    };
+  }
+
+  //index of the last point in the shape
+  size_t last_point(const std::vector<int32_t>& coordinates) {
+    return coordinates.size() < 2 ? 0 : coordinates.size() / 2 - 1;
+  }
+
+  //points [begin, end] of the shape as a geojson linestring
+  streamed_t geometry(const std::vector<int32_t>& coordinates, size_t begin, size_t end) {
+    return [&coordinates, begin, end](std::ostream& stream) {
+      tyr::write_geojson(coordinates, begin, end, stream);
+    };
+  }
+
+}
+
+namespace valhalla {
+  namespace tyr {
+
+    namespace osrm_serializers {
+      namespace {
+      /*
+      OSRM output looks like this:
+      {
+          "hint_data": {
+              "locations": [
+                  "_____38_SADaFQQAKwEAABEAAAAAAAAAdgAAAFfLwga4tW0C4P6W-wAARAA",
+                  "fzhIAP____8wFAQA1AAAAC8BAAAAAAAAAAAAAP____9Uu20CGAiX-wAAAAA"
+              ],
+              "checksum": 2875622111
+          },
+          "route_name": [ "West 26th Street", "Madison Avenue" ],
+          "via_indices": [ 0, 9 ],
+          "found_alternative": false,
+          "route_summary": {
+              "end_point": "West 29th Street",
+              "start_point": "West 26th Street",
+              "total_time": 145,
+              "total_distance": 878
+          },
+          "via_points": [ [ 40.744377, -73.990433 ], [40.745811, -73.988075 ] ],
+          "route_instructions": [
+              [ "10", "West 26th Street", 216, 0, 52, "215m", "SE", 118 ],
+              [ "1", "East 26th Street", 153, 2, 29, "153m", "SE", 120 ],
+              [ "7", "Madison Avenue", 237, 3, 25, "236m", "NE", 29 ],
+              [ "7", "East 29th Street", 155, 6, 29, "154m", "NW", 299 ],
+              [ "1", "West 29th Street", 118, 7, 21, "117m", "NW", 299 ],
+              [ "15", "", 0, 8, 0, "0m", "N", 0 ]
+          ],
+          "route_geometry": "ozyulA~p_clCfc@ywApTar@li@ybBqe@c[ue@e[ue@i[ci@dcB}^rkA",
+          "status_message": "Found route between points",
+          "status": 0
+      }
+      */
+
+      json::ArrayPtr route_name(const valhalla::odin::TripDirections& trip_directions){
+        auto route_name = json::array({});
+        if(trip_directions.maneuver_size() > 0) {
+          if(trip_directions.maneuver(0).street_name_size() > 0) {
+            route_name->push_back(trip_directions.maneuver(0).street_name(0));
+          }
+          if(trip_directions.maneuver(trip_directions.maneuver_size() - 1).street_name_size() > 0) {
+            route_name->push_back(trip_directions.maneuver(trip_directions.maneuver_size() - 1).street_name(0));
+          }
+        }
+        return route_name;
+      }
+
+      json::ArrayPtr via_indices(const valhalla::odin::TripDirections& trip_directions){
+        auto via_indices = json::array({});
+        if(trip_directions.maneuver_size() > 0) {
+          via_indices->push_back(static_cast<uint64_t>(0));
+          via_indices->push_back(static_cast<uint64_t>(trip_directions.maneuver_size() - 1));
+        }
+        return via_indices;
+      }
+
+      json::MapPtr route_summary(const valhalla::odin::TripDirections& trip_directions){
+        auto route_summary = json::map({});
+        if(trip_directions.maneuver_size() > 0) {
+          if(trip_directions.maneuver(0).street_name_size() > 0)
+            route_summary->emplace("start_point", trip_directions.maneuver(0).street_name(0));
+          else
+            route_summary->emplace("start_point", string(""));
+          if(trip_directions.maneuver(trip_directions.maneuver_size() - 1).street_name_size() > 0)
+            route_summary->emplace("end_point", trip_directions.maneuver(trip_directions.maneuver_size() - 1).street_name(0));
+          else
+            route_summary->emplace("end_point", string(""));
+        }
+        uint64_t seconds = 0, meters = 0;
+        for(const auto& maneuver : trip_directions.maneuver()) {
+          meters += static_cast<uint64_t>(maneuver.length() * 1000.f);
+          seconds += static_cast<uint64_t>(maneuver.time());
+        }
+        route_summary->emplace("total_time", seconds);
+        route_summary->emplace("total_distance", meters);
+        return route_summary;
+      }
+
+      json::ArrayPtr via_points(const valhalla::odin::TripDirections& trip_directions){
+        auto via_points = json::array({});
+        for(const auto& location : trip_directions.location()) {
+          via_points->emplace_back(json::array({json::fp_t{location.ll().lat(),6}, json::fp_t{location.ll().lng(),6}}));
+        }
+        return via_points;
+      }
+
+      const std::unordered_map<int, std::string> maneuver_type = {
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kNone),             "0" },//NoTurn = 0,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kContinue),         "1" },//GoStraight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kBecomes),          "1" },//GoStraight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kRampStraight),     "1" },//GoStraight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kStayStraight),     "1" },//GoStraight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kMerge),            "1" },//GoStraight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kFerryEnter),       "1" },//GoStraight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kFerryExit),        "1" },//GoStraight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kSlightRight),      "2" },//TurnSlightRight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kRight),            "3" },//TurnRight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kRampRight),        "3" },//TurnRight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kExitRight),        "3" },//TurnRight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kStayRight),        "3" },//TurnRight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kSharpRight),       "4" },//TurnSharpRight,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kUturnLeft),        "5" },//UTurn,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kUturnRight),       "5" },//UTurn,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kSharpLeft),        "6" },//TurnSharpLeft,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kLeft),             "7" },//TurnLeft,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kRampLeft),         "7" },//TurnLeft,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kExitLeft),         "7" },//TurnLeft,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kStayLeft),         "7" },//TurnLeft,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kSlightLeft),       "8" },//TurnSlightLeft,
+          //{ static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_k),               "9" },//ReachViaLocation,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kRoundaboutEnter),  "11" },//EnterRoundAbout,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kRoundaboutExit),   "12" },//LeaveRoundAbout,
+          //{ static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_k),               "13" },//StayOnRoundAbout,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kStart),            "14" },//StartAtEndOfStreet,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kStartRight),       "14" },//StartAtEndOfStreet,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kStartLeft),        "14" },//StartAtEndOfStreet,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kDestination),      "15" },//ReachedYourDestination,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kDestinationRight), "15" },//ReachedYourDestination,
+          { static_cast<int>(valhalla::odin::TripDirections_Maneuver_Type_kDestinationLeft),  "15" },//ReachedYourDestination,
+          //{ static_cast<int>valhalla::odin::TripDirections_Maneuver_Type_k),                "16" },//EnterAgainstAllowedDirection,
+          //{ static_cast<int>valhalla::odin::TripDirections_Maneuver_Type_k),                "17" },//LeaveAgainstAllowedDirection
+      };
+
+      const std::unordered_map<int, std::string> cardinal_direction_string = {
+        { static_cast<int>(valhalla::odin::TripDirections_Maneuver_CardinalDirection_kNorth),     "N" },
+        { static_cast<int>(valhalla::odin::TripDirections_Maneuver_CardinalDirection_kNorthEast), "NE" },
+        { static_cast<int>(valhalla::odin::TripDirections_Maneuver_CardinalDirection_kEast),      "E" },
+        { static_cast<int>(valhalla::odin::TripDirections_Maneuver_CardinalDirection_kSouthEast), "SE" },
+        { static_cast<int>(valhalla::odin::TripDirections_Maneuver_CardinalDirection_kSouth),     "S" },
+        { static_cast<int>(valhalla::odin::TripDirections_Maneuver_CardinalDirection_kSouthWest), "SW" },
+        { static_cast<int>(valhalla::odin::TripDirections_Maneuver_CardinalDirection_kWest),      "W" },
+        { static_cast<int>(valhalla::odin::TripDirections_Maneuver_CardinalDirection_kNorthWest), "NW" }
+      };
+
+      json::ArrayPtr route_instructions(const valhalla::odin::TripDirections& trip_directions){
+        auto route_instructions = json::array({});
+        for(const auto& maneuver : trip_directions.maneuver()) {
+          //if we dont know the type of maneuver then skip it
+          auto maneuver_text = maneuver_type.find(static_cast<int>(maneuver.type()));
+          if(maneuver_text == maneuver_type.end())
+            continue;
+
+          //length
+          std::ostringstream length;
+          length << static_cast<uint64_t>(maneuver.length()*1000.f) << "m";
+
+          //json
+          route_instructions->emplace_back(json::array({
+            maneuver_text->second, //maneuver type
+            (maneuver.street_name_size() ? maneuver.street_name(0) : string("")), //street name
+            static_cast<uint64_t>(maneuver.length() * 1000.f), //length in meters
+            static_cast<uint64_t>(maneuver.begin_shape_index()), //index in the shape
+            static_cast<uint64_t>(maneuver.time()), //time in seconds
+            length.str(), //length as a string with a unit suffix
+            cardinal_direction_string.find(static_cast<int>(maneuver.begin_cardinal_direction()))->second, // one of: N S E W NW NE SW SE
+            static_cast<uint64_t>(maneuver.begin_heading())
+          }));
+        }
+        return route_instructions;
+      }
+
+      }
+
+      void serialize(const valhalla::odin::DirectionsOptions& directions_options,
+        const valhalla::odin::TripDirections& trip_directions,
+        shape_format_t shape_format,
+        std::ostringstream& stream) {
+
+        //TODO: worry about multipoint routes
+
+        //build up the json object
+        auto json = json::map
+        ({
+          {"hint_data", json::map
+            ({
+              {"locations", json::array({ string(""), string("") })}, //TODO: are these internal ids?
+              {"checksum", static_cast<uint64_t>(0)} //TODO: what is this exactly?
+            })
+          },
+          {"route_name", route_name(trip_directions)}, //TODO: list of all of the streets or just the via points?
+          {"via_indices", via_indices(trip_directions)}, //maneuver index
+          {"found_alternative", static_cast<bool>(false)}, //no alt route support
+          {"route_summary", route_summary(trip_directions)}, //start/end name, total time/distance
+          {"via_points", via_points(trip_directions)}, //array of lat,lng pairs
+          {"route_instructions", route_instructions(trip_directions)}, //array of maneuvers
+          {"status_message", string("Found route between points")}, //found route between points OR cannot find route between points
+          {"status", static_cast<uint64_t>(0)} //0 success or 207 no route
+        });
+
+        //the polyline encoded shape is just a string
+        if(shape_format == shape_format_t::POLYLINE) {
+          json->emplace("route_geometry", trip_directions.shape());
+          stream << *json;
+          return;
+        }
+
+        //geojson writes itself into the stream, osrm has no per maneuver geometry so its the whole shape
+        std::vector<int32_t> coordinates;
+        decode_polyline(trip_directions.shape(), coordinates);
+        stream << object_t{json, {{"route_geometry", geometry(coordinates, 0, last_point(coordinates))}}};
+      }
+    }
+
+    namespace valhalla_serializers {
+      namespace {
+      /*
+      valhalla output looks like this:
+      {
+          "trip":
+      {
+          "status": 0,
+          "locations": [
+             {
+              "longitude": -76.4791,
+              "latitude": 40.4136,
+               "stopType": 0
+             },
+             {
+              "longitude": -76.5352,
+              "latitude": 40.4029,
+              "stopType": 0
+             }
+           ],
+          "units": "kilometers"
+          "summary":
+      {
+          "distance": 4973,
+          "time": 325
+      },
+      "legs":
+      [
+        {
+            "summary":
+        {
+            "distance": 4973,
+            "time": 325
+        },
+        "maneuvers":
+        [
+          {
+              "beginShapeIndex": 0,
+              "distance": 633,
+              "writtenInstruction": "Start out going west on West Market Street.",
+              "streetNames":
+              [
+                  "West Market Street"
+              ],
+              "type": 1,
+              "time": 41
+          },
+          {
+              "beginShapeIndex": 7,
+              "distance": 4340,
+              "writtenInstruction": "Continue onto Jonestown Road.",
+              "streetNames":
+              [
+                  "Jonestown Road"
+              ],
+              "type": 8,
+              "time": 284
+          },
+          {
+              "beginShapeIndex": 40,
+              "distance": 0,
+              "writtenInstruction": "You have arrived at your destination.",
+              "type": 4,
+              "time": 0
+          }
+      ],
+      "shape": "gysalAlg|zpC~Clt@tDtx@hHfaBdKl{BrKbnApGro@tJrz@jBbQj@zVt@lTjFnnCrBz}BmFnoB]pHwCvm@eJxtATvXTnfAk@|^z@rGxGre@nTpnBhBbQvXduCrUr`Edd@naEja@~gAhk@nzBxf@byAfm@tuCvDtOvNzi@|jCvkKngAl`HlI|}@`N`{Adx@pjE??xB|J"
+      }
+      ],
+      "status_message": "Found route between points"
+      }
+      }
+      */
+      using namespace std;
+
+      json::MapPtr summary(const valhalla::odin::TripDirections& trip_directions){
+
+        // TODO: multiple legs.
+
+        auto route_summary = json::map({});
+        route_summary->emplace("time", static_cast<uint64_t>(trip_directions.summary().time()));
+        route_summary->emplace("length", json::fp_t{trip_directions.summary().length(), 3});
+        return route_summary;
+      }
+
+      json::ArrayPtr locations(const valhalla::odin::TripDirections& trip_directions){
+        auto locations = json::array({});
+        for(const auto& location : trip_directions.location()) {
+
+          auto loc = json::map({});
+
+          if (location.type() == valhalla::odin::TripDirections_Location_Type_kThrough) {
+            loc->emplace("type", std::string("through"));
+          } else {
+            loc->emplace("type", std::string("break"));
+          }
+          loc->emplace("lat", json::fp_t{location.ll().lat(), 6});
+          loc->emplace("lon",json::fp_t{location.ll().lng(), 6});
+          if (!location.name().empty())
+            loc->emplace("name",location.name());
+          if (!location.street().empty())
+            loc->emplace("street",location.street());
+          if (!location.city().empty())
+            loc->emplace("city",location.city());
+          if (!location.state().empty())
+            loc->emplace("state",location.state());
+          if (!location.postal_code().empty())
+            loc->emplace("postal_code",location.postal_code());
+          if (!location.country().empty())
+            loc->emplace("country",location.country());
+          if (location.has_heading())
+            loc->emplace("heading",static_cast<uint64_t>(location.heading()));
+          if (!location.date_time().empty())
+            loc->emplace("date_time",location.date_time());
+
+          //loc->emplace("sideOfStreet",location.side_of_street());
+
+          locations->emplace_back(loc);
+        }
+
+        return locations;
+      }
+
+      json::MapPtr maneuver(const valhalla::odin::TripDirections_Maneuver& maneuver){
+
+        auto man = json::map({});
+
+        man->emplace("type", static_cast<uint64_t>(maneuver.type()));
+        man->emplace("instruction", maneuver.text_instruction());
+        //“verbalTransitionAlertInstruction” : “<verbalTransitionAlertInstruction>”,
+        //“verbalPreTransitionInstruction” : “<verbalPreTransitionInstruction>”,
+        //“verbalPostTransitionInstruction” : “<verbalPostTransitionInstruction>”,
+        auto street_names = json::array({});
+
+        for (int i = 0; i < maneuver.street_name_size(); i++)
+          street_names->emplace_back(maneuver.street_name(i));
+
+        if (street_names->size())
+          man->emplace("street_names", street_names);
+        man->emplace("time", static_cast<uint64_t>(maneuver.time()));
+        man->emplace("length", json::fp_t{maneuver.length(), 3});
+        man->emplace("begin_shape_index", static_cast<uint64_t>(maneuver.begin_shape_index()));
+        man->emplace("end_shape_index", static_cast<uint64_t>(maneuver.end_shape_index()));
+
+        if (maneuver.portions_toll())
+          man->emplace("toll", maneuver.portions_toll());
+        if (maneuver.portions_unpaved())
+          man->emplace("rough", maneuver.portions_unpaved());
+
+        //  man->emplace("hasGate", maneuver.);
+        //  man->emplace("hasFerry", maneuver.);
+        //“portionsTollNote” : “<portionsTollNote>”,
+        //“portionsUnpavedNote” : “<portionsUnpavedNote>”,
+        //“gateAccessRequiredNote” : “<gateAccessRequiredNote>”,
+        //“checkFerryInfoNote” : “<checkFerryInfoNote>”
+        return man;
+      }
+
+      json::MapPtr leg_summary(const valhalla::odin::TripDirections& trip_directions){
+        auto summary = json::map({});
+        summary->emplace("time", static_cast<uint64_t>(trip_directions.summary().time()));
+        summary->emplace("length", json::fp_t{trip_directions.summary().length(), 3});
+        return summary;
+      }
+
+      //the legs with the shape as an encoded polyline
+      json::ArrayPtr legs(const valhalla::odin::TripDirections& trip_directions){
+
+        // TODO: multiple legs.
+        auto legs = json::array({});
+        auto leg = json::map({});
+        auto maneuvers = json::array({});
+
+        for(const auto& man : trip_directions.maneuver())
+          maneuvers->emplace_back(maneuver(man));
+        leg->emplace("maneuvers", maneuvers);
+        leg->emplace("summary", leg_summary(trip_directions));
+        leg->emplace("shape", trip_directions.shape());
+
+        legs->emplace_back(leg);
+        return legs;
+      }
+
+      //the legs with geojson geometry for the shape, these stream themselves
+      streamed_t legs(const valhalla::odin::TripDirections& trip_directions, shape_format_t shape_format,
+        const std::vector<int32_t>& coordinates){
+
+        // TODO: multiple legs.
+        object_t leg{json::map({}), {}};
+        std::vector<object_t> maneuvers;
+
+        for(const auto& man : trip_directions.maneuver()) {
+          maneuvers.push_back({maneuver(man), {}});
+          if(shape_format == shape_format_t::GEOJSON_MANEUVERS)
+            maneuvers.back().streamed.emplace_back("shape", geometry(coordinates, man.begin_shape_index(), man.end_shape_index()));
+        }
+        leg.streamed.emplace_back("maneuvers", streamed_array(maneuvers));
+        leg.members->emplace("summary", leg_summary(trip_directions));
+        leg.streamed.emplace_back("shape", geometry(coordinates, 0, last_point(coordinates)));
+
+        return streamed_array(std::vector<object_t>{leg});
+      }
+      }
+
+      void serialize(const valhalla::odin::DirectionsOptions& directions_options,
+                     const valhalla::odin::TripDirections& trip_directions,
+                     shape_format_t shape_format,
+                     std::ostringstream& stream) {
+
+        //TODO: worry about multipoint routes
+
+        //build up the json object
+        auto trip = json::map
+            ({
+                {"locations", locations(trip_directions)},
+                {"summary", summary(trip_directions)},
+                {"status_message", string("Found route between points")}, //found route between points OR cannot find route between points
+                {"status", static_cast<uint64_t>(0)}, //0 success or 207 no route
+                {"units", std::string((directions_options.units() == valhalla::odin::DirectionsOptions::kKilometers) ? "kilometers" : "miles")}
+            });
+
+        //the shape is just a string so its all plain json
+        if(shape_format == shape_format_t::POLYLINE) {
+          trip->emplace("legs", legs(trip_directions));
+          stream << *json::map({{"trip", trip}});
+          return;
+        }
+
+        //otherwise the legs have the geometry, which writes itself into the stream
+        std::vector<int32_t> coordinates;
+        decode_polyline(trip_directions.shape(), coordinates);
+        object_t streamed_trip{trip, {{"legs", legs(trip_directions, shape_format, coordinates)}}};
+        stream << object_t{json::map({}), {{"trip", [&streamed_trip](std::ostream& stream) { stream << streamed_trip; }}}};
+      }
+    }
+
+  }
+}
@@ -8,6 +8,9 @@
 #include <memory>
 #include <stdexcept>
 #include <sstream>
+#include <cstdlib>
+#include <vector>
+#include <utility>
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
@@ -22,6 +25,36 @@ using namespace prime_server;
 #include "valhalla/thor/service.h"
 #include "valhalla/odin/service.h"
 #include "valhalla/tyr/service.h"
+#include "valhalla/tyr/drain.h"
+#include "valhalla/tyr/lanes.h"
+#include "valhalla/tyr/listener.h"
+
+namespace {
+
+  //the stages of the pipeline, each has its own proxy and pool of workers
+  const std::vector<std::pair<std::string, void (*)(const boost::property_tree::ptree&)> > STAGES = {
+    {"loki", valhalla::loki::run_service},
+    {"thor", valhalla::thor::run_service},
+    {"odin", valhalla::odin::run_service},
+    {"tyr", valhalla::tyr::run_service},
+  };
+
+  //start up the proxies and workers for each stage of a lane
+  void start_lane(zmq::context_t& context, const valhalla::tyr::lane_t& lane) {
+    LOG_INFO("Starting " + lane.name + " lane with " + std::to_string(lane.workers) + " workers per stage");
+    for(const auto& stage : STAGES) {
+      auto proxy = lane.config.get<std::string>(stage.first + ".service.proxy");
+      std::thread proxy_thread(std::bind(&proxy_t::forward, proxy_t(context, proxy + "_in", proxy + "_out")));
+      proxy_thread.detach();
+      for(size_t i = 0; i < lane.workers; ++i) {
+        std::thread worker_thread(stage.second, lane.config);
+        worker_thread.detach();
+      }
+    }
+    //TODO: add multipoint accumulator worker
+  }
+
+}
 
 int main(int argc, char** argv) {
 
@@ -36,14 +69,15 @@ int main(int argc, char** argv) {
   boost::property_tree::ptree config;
   boost::property_tree::read_json(config_file, config);
 
+  //number of workers to use at each stage
+  auto worker_concurrency = std::thread::hardware_concurrency();
+  if(argc > 2)
+    worker_concurrency = std::stoul(argv[2]);
+
   //grab the endpoints
   std::string listen = config.get<std::string>("httpd.service.listen");
   std::string loopback = config.get<std::string>("httpd.service.loopback");
   std::string loki_proxy = config.get<std::string>("loki.service.proxy");
-  std::string thor_proxy = config.get<std::string>("thor.service.proxy");
-  std::string odin_proxy = config.get<std::string>("odin.service.proxy");
-  std::string tyr_proxy = config.get<std::string>("tyr.service.proxy");
-  //TODO: add multipoint accumulator worker
 
   //check the server endpoint
   if(listen.find("tcp://") != 0) {
@@ -55,57 +89,89 @@ int main(int argc, char** argv) {
       LOG_WARN("Listening on a domain socket limits the server to local requests");
   }
 
-  //number of workers to use at each stage
-  auto worker_concurrency = std::thread::hardware_concurrency();
-  if(argc > 2)
-    worker_concurrency = std::stoul(argv[2]);
+  //figure out how to split up the work
+  std::vector<valhalla::tyr::lane_t> lanes;
+  try {
+    lanes = valhalla::tyr::get_lanes(config);
+    valhalla::tyr::reserve_workers(lanes, worker_concurrency);
+  }
+  catch(const std::exception& e) {
+    LOG_ERROR(e.what());
+    return EXIT_FAILURE;
+  }
+
+  //to hand the port over to a replacement while we drain we listen on it with SO_REUSEPORT.
+  //the server cant share its socket like that so it gets a private port behind the listener
+  std::unique_ptr<valhalla::tyr::listener_t> listener;
+  auto server_listen = listen;
+  if(config.get<bool>("httpd.service.reuse_port", false)) {
+    try {
+      auto port = valhalla::tyr::listener_t::free_port();
+      listener.reset(new valhalla::tyr::listener_t(listen, port));
+      server_listen = "tcp://127.0.0.1:" + std::to_string(port);
+    }
+    catch(const std::exception& e) {
+      LOG_ERROR(e.what());
+      return EXIT_FAILURE;
+    }
+  }
+
+  //only the main thread should hear about shutting down, this has to happen
+  //before the zmq context starts its io threads so they inherit the mask
+  valhalla::tyr::block_shutdown_signals();
 
   //setup the cluster within this process
   zmq::context_t context;
+  //the server goes through the gate so we know what is in flight and can stop taking requests
+  valhalla::tyr::intake_t intake;
+  auto grace = valhalla::tyr::drain_grace(config);
+  valhalla::tyr::gate_t gate(loki_proxy + "_gate", loki_proxy + "_in", loopback, loopback + "_gate", intake, grace);
+  std::thread gate_thread(&valhalla::tyr::gate_t::pass, &gate);
   std::thread server_thread = std::thread(std::bind(&http_server_t::serve,
-    http_server_t(context, listen, loki_proxy + "_in", loopback, true)));
-
-  //loki layer
-  std::thread loki_proxy_thread(std::bind(&proxy_t::forward, proxy_t(context, loki_proxy + "_in", loki_proxy + "_out")));
-  loki_proxy_thread.detach();
-  std::list<std::thread> loki_worker_threads;
-  for(size_t i = 0; i < worker_concurrency; ++i) {
-    loki_worker_threads.emplace_back(valhalla::loki::run_service, config);
-    loki_worker_threads.back().detach();
+    http_server_t(context, server_listen, loki_proxy + "_gate", loopback + "_gate", true)));
+  server_thread.detach();
+  std::thread listener_thread;
+  if(listener)
+    listener_thread = std::thread(&valhalla::tyr::listener_t::pump, listener.get());
+
+  //with more than one lane requests are classified before going into a lane
+  if(lanes.size() > 1) {
+    std::thread router_thread([&context, loki_proxy, lanes]() {
+      valhalla::tyr::router_t router(context, loki_proxy + "_in", lanes);
+      router.route();
+    });
+    router_thread.detach();
   }
-
-  //thor layer
-  std::thread thor_proxy_thread(std::bind(&proxy_t::forward, proxy_t(context, thor_proxy + "_in", thor_proxy + "_out")));
-  thor_proxy_thread.detach();
-  std::list<std::thread> thor_worker_threads;
-  for(size_t i = 0; i < worker_concurrency; ++i) {
-    thor_worker_threads.emplace_back(valhalla::thor::run_service, config);
-    thor_worker_threads.back().detach();
-  }
-
-  //odin layer
-  std::thread odin_proxy_thread(std::bind(&proxy_t::forward, proxy_t(context, odin_proxy + "_in", odin_proxy + "_out")));
-  odin_proxy_thread.detach();
-  std::list<std::thread> odin_worker_threads;
-  for(size_t i = 0; i < worker_concurrency; ++i) {
-    odin_worker_threads.emplace_back(valhalla::odin::run_service, config);
-    odin_worker_threads.back().detach();
+  for(const auto& lane : lanes) {
+    if(lane.workers)
+      start_lane(context, lane);
+    else
+      LOG_WARN("Not enough workers for the " + lane.name + " lane, its requests will use the default lane");
   }
 
-  //tyr layer
-  std::thread tyr_proxy_thread(std::bind(&proxy_t::forward, proxy_t(context, tyr_proxy + "_in", tyr_proxy + "_out")));
-  tyr_proxy_thread.detach();
-  std::list<std::thread> tyr_worker_threads;
-  for(size_t i = 0; i < worker_concurrency; ++i) {
-    tyr_worker_threads.emplace_back(valhalla::tyr::run_service, config);
-    tyr_worker_threads.back().detach();
+  //wait for interrupt, stop taking requests and let the ones we have work their way out
+  auto signal = valhalla::tyr::wait_for_shutdown();
+  LOG_INFO("Got signal " + std::to_string(signal) + ", draining " + std::to_string(intake.in_flight()) + " in flight requests");
+  //new connections go to whoever else is listening on the port from now on
+  if(listener)
+    listener->close();
+  auto drained = intake.drain(config);
+  if(drained)
+    LOG_INFO("Drained all in flight requests");
+  else
+    LOG_WARN("Timed out with " + std::to_string(intake.in_flight()) + " requests still in flight");
+
+  //get the last responses out of the gate and give the server a moment to write them
+  gate.stop();
+  gate_thread.join();
+  std::this_thread::sleep_for(grace);
+  if(listener) {
+    listener->stop();
+    listener_thread.join();
   }
 
-  //TODO: add multipoint accumulator
-
-  //wait forever (or for interrupt)
-  server_thread.join();
-
-  return 0;
+  //none of the threads ever return so tearing down the context would hang
+  std::cout.flush();
+  std::cerr.flush();
+  std::quick_exit(drained ? EXIT_SUCCESS : EXIT_FAILURE);
 }
-
@@ -1,14 +1,21 @@
 #include <iostream>
+#include <thread>
+#include <functional>
+#include <cstdlib>
+#include <unistd.h>
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
+#include <valhalla/midgard/logging.h>
+
 #include "tyr/service.h"
+#include "tyr/drain.h"
 
 int main(int argc, char** argv) {
 
   if(argc < 2) {
-    std::cerr << "Usage: " << std::string(argv[0]) << " conf/valhalla.json" << std::endl;
+    LOG_ERROR("Usage: " + std::string(argv[0]) + " conf/valhalla.json");
     return 1;
   }
 
@@ -17,8 +24,37 @@ int main(int argc, char** argv) {
   boost::property_tree::ptree config;
   boost::property_tree::read_json(config_file, config);
 
-  //run the service worker
-  valhalla::tyr::run_service(config);
+  //only the main thread should hear about shutting down
+  valhalla::tyr::block_shutdown_signals();
+
+  //the worker's responses go through a gate so we know when they have actually left
+  auto loopback = config.get<std::string>("httpd.service.loopback");
+  auto worker_config = config;
+  worker_config.put("httpd.service.loopback", loopback + "_tyr_" + std::to_string(getpid()));
+  valhalla::tyr::intake_t intake;
+  valhalla::tyr::gate_t gate("", "", worker_config.get<std::string>("httpd.service.loopback"), loopback,
+    intake, valhalla::tyr::drain_grace(config));
+  std::thread gate_thread(&valhalla::tyr::gate_t::pass, &gate);
+
+  //run the service worker, it is the way into this process so it admits the jobs
+  std::thread(static_cast<void (*)(const boost::property_tree::ptree&, valhalla::tyr::intake_t&)>(valhalla::tyr::run_service),
+    worker_config, std::ref(intake)).detach();
+
+  //when asked to stop turn away new jobs and let the ones we have finish first
+  auto signal = valhalla::tyr::wait_for_shutdown();
+  LOG_INFO("Got signal " + std::to_string(signal) + ", draining " + std::to_string(intake.in_flight()) + " in flight requests");
+  auto drained = intake.drain(config);
+  if(drained)
+    LOG_INFO("Drained all in flight requests");
+  else
+    LOG_WARN("Timed out with " + std::to_string(intake.in_flight()) + " requests still in flight");
+
+  //get the last responses out of the gate
+  gate.stop();
+  gate_thread.join();
 
-  return 0;
+  //the worker never returns so we cant unwind its zmq sockets, just leave
+  std::cout.flush();
+  std::cerr.flush();
+  std::quick_exit(drained ? EXIT_SUCCESS : EXIT_FAILURE);
 }
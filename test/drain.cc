@@ -0,0 +1,249 @@
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <list>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <memory>
+#include <unistd.h>
+#include <prime_server/prime_server.hpp>
+#include <prime_server/http_protocol.hpp>
+
+#include "tyr/drain.h"
+
+using namespace valhalla::tyr;
+using namespace prime_server;
+
+namespace {
+
+  void test_drain_waits() {
+    //a request that finishes a bit after we start draining
+    intake_t intake;
+    if(!intake.admit(1))
+      throw std::runtime_error("An open intake should admit requests");
+    std::thread worker([&intake](){
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      intake.finish(1);
+    });
+    auto start = std::chrono::steady_clock::now();
+    auto drained = intake.drain(std::chrono::seconds(5));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    worker.join();
+    if(!drained)
+      throw std::runtime_error("Drain should have finished before the timeout");
+    if(elapsed < std::chrono::milliseconds(90))
+      throw std::runtime_error("Drain returned before the request finished");
+    if(intake.in_flight())
+      throw std::runtime_error("Nothing should be in flight after draining");
+  }
+
+  void test_drain_empty() {
+    //nothing in flight means there is nothing to wait for
+    intake_t intake;
+    auto start = std::chrono::steady_clock::now();
+    if(!intake.drain(std::chrono::seconds(5)))
+      throw std::runtime_error("Drain should have finished right away");
+    if(std::chrono::steady_clock::now() - start > std::chrono::seconds(1))
+      throw std::runtime_error("Drain waited with nothing in flight");
+  }
+
+  void test_drain_closes() {
+    //while draining new requests are turned away so they cant hold us up
+    intake_t intake;
+    intake.admit(0);
+    std::atomic<bool> reopened(false);
+    std::thread worker([&intake, &reopened](){
+      //keep requests coming until the intake closes on us
+      uint64_t id = 1;
+      while(intake.admit(id))
+        intake.finish(id++);
+      //once its closed it has to stay that way
+      for(int i = 0; i < 100; ++i)
+        if(intake.admit(id + i))
+          reopened = true;
+      intake.finish(0);
+    });
+    auto drained = intake.drain(std::chrono::seconds(5));
+    worker.join();
+    if(!drained)
+      throw std::runtime_error("Drain should have finished before the timeout");
+    if(reopened)
+      throw std::runtime_error("A draining intake should not admit requests");
+    if(intake.admit(1))
+      throw std::runtime_error("A drained intake should stay closed");
+  }
+
+  void test_drain_timeout() {
+    intake_t intake;
+    intake.admit(1);
+    auto start = std::chrono::steady_clock::now();
+    if(intake.drain(std::chrono::milliseconds(100)))
+      throw std::runtime_error("Drain should have timed out on a stuck request");
+    if(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100))
+      throw std::runtime_error("Drain gave up before the timeout");
+    if(intake.in_flight() != 1)
+      throw std::runtime_error("The stuck request should still be in flight");
+  }
+
+  void test_finish_unknown() {
+    //a response for something we didnt let in shouldnt change the count
+    intake_t intake;
+    intake.finish(1);
+    intake.admit(2);
+    intake.finish(3);
+    if(intake.in_flight() != 1)
+      throw std::runtime_error("Finishing a request we didnt admit should be ignored");
+  }
+
+  //stands in for the http server, the proxy and a worker around a gate
+  struct pipeline_t {
+    pipeline_t():
+      prefix("ipc:///tmp/test_drain_" + std::to_string(getpid()) + "_"),
+      server(context, ZMQ_DEALER), server_loopback(context, ZMQ_SUB),
+      proxy(context, ZMQ_ROUTER), worker(context, ZMQ_PUB) {
+      int linger = 0;
+      for(auto* socket : {&server, &server_loopback, &proxy, &worker})
+        socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+      server_loopback.setsockopt(ZMQ_SUBSCRIBE, "", 0);
+      server_loopback.bind((prefix + "server_loopback").c_str());
+      proxy.bind((prefix + "downstream").c_str());
+      gate.reset(new gate_t(prefix + "upstream", prefix + "downstream", prefix + "loopback",
+        prefix + "server_loopback", intake, std::chrono::seconds(1)));
+      gate_thread = std::thread(&gate_t::pass, gate.get());
+      server.connect((prefix + "upstream").c_str());
+      worker.connect((prefix + "loopback").c_str());
+      //give the subscriptions time to get through, a bound subscriber only passes its
+      //subscription on to a new publisher when its thread is using it so keep polling
+      for(int i = 0; i < 10; ++i)
+        if(!receive(server_loopback, 50).empty())
+          throw std::runtime_error("The server should not get anything before it asks");
+    }
+    ~pipeline_t() {
+      stop();
+    }
+    void stop() {
+      if(gate_thread.joinable()) {
+        gate->stop();
+        gate_thread.join();
+      }
+    }
+    void request(uint64_t id) {
+      http_request_t::info_t info{};
+      info.id = id;
+      server.send_all({zmq::message_t(&info, sizeof(info)), zmq::message_t("request", 7)}, 0);
+    }
+    void respond(uint64_t id) {
+      http_request_t::info_t info{};
+      info.id = id;
+      worker.send_all({zmq::message_t(&info, sizeof(info)), zmq::message_t("response", 8)}, 0);
+    }
+    //the frames if something shows up on the socket within the timeout
+    std::list<zmq::message_t> receive(zmq::socket_t& socket, long timeout = 1000) {
+      zmq::pollitem_t item{static_cast<void*>(socket), 0, ZMQ_POLLIN, 0};
+      if(zmq::poll(&item, 1, timeout) > 0 && (item.revents & ZMQ_POLLIN))
+        return socket.recv_all(0);
+      return {};
+    }
+    bool wait_for(size_t in_flight) {
+      for(int i = 0; i < 100 && intake.in_flight() != in_flight; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      return intake.in_flight() == in_flight;
+    }
+
+    std::string prefix;
+    intake_t intake;
+    zmq::context_t context;
+    zmq::socket_t server, server_loopback, proxy, worker;
+    std::unique_ptr<gate_t> gate;
+    std::thread gate_thread;
+  };
+
+  uint64_t id_of(const std::list<zmq::message_t>& messages, size_t frame) {
+    auto message = std::next(messages.begin(), frame);
+    if(message->size() < sizeof(http_request_t::info_t))
+      throw std::runtime_error("Frame is too small to be request info");
+    uint64_t id;
+    std::memcpy(&id, static_cast<const char*>(message->data()) + offsetof(http_request_t::info_t, id), sizeof(id));
+    return id;
+  }
+
+  void test_gate_finishes_after_send() {
+    pipeline_t pipeline;
+    pipeline.request(7);
+    //the request goes on to the proxy with the servers identity in front
+    auto forwarded = pipeline.receive(pipeline.proxy);
+    if(forwarded.size() != 3 || id_of(forwarded, 1) != 7)
+      throw std::runtime_error("The request should have been forwarded to the proxy");
+    if(pipeline.intake.in_flight() != 1)
+      throw std::runtime_error("A forwarded request should be in flight");
+    //by the time the request is finished its response has to be on its way to the server
+    pipeline.respond(7);
+    if(!pipeline.wait_for(0))
+      throw std::runtime_error("The request should finish once its response passes through");
+    auto response = pipeline.receive(pipeline.server_loopback);
+    if(response.size() != 2 || id_of(response, 0) != 7)
+      throw std::runtime_error("The server should get the response of a finished request");
+  }
+
+  void test_gate_flushes() {
+    //draining then stopping the gate is what a process does right before it exits
+    pipeline_t pipeline;
+    pipeline.request(3);
+    pipeline.receive(pipeline.proxy);
+    std::thread worker([&pipeline](){
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      pipeline.respond(3);
+    });
+    auto drained = pipeline.intake.drain(std::chrono::seconds(5));
+    worker.join();
+    pipeline.stop();
+    if(!drained)
+      throw std::runtime_error("Drain should have finished before the timeout");
+    auto response = pipeline.receive(pipeline.server_loopback);
+    if(response.size() != 2 || id_of(response, 0) != 3)
+      throw std::runtime_error("The last response should be out once the gate has stopped");
+  }
+
+  void test_gate_turns_away() {
+    //once closed requests get a 503 from the gate and never reach the pipeline
+    pipeline_t pipeline;
+    pipeline.intake.drain(std::chrono::seconds(0));
+    pipeline.request(5);
+    auto response = pipeline.receive(pipeline.server_loopback);
+    if(response.size() != 2 || id_of(response, 0) != 5)
+      throw std::runtime_error("A request after closing should be answered right away");
+    std::string text(static_cast<const char*>(response.back().data()), response.back().size());
+    if(text.find("503") == std::string::npos)
+      throw std::runtime_error("A request after closing should get a 503");
+    if(!pipeline.receive(pipeline.proxy, 100).empty())
+      throw std::runtime_error("A request after closing should not reach the proxy");
+    if(pipeline.intake.in_flight())
+      throw std::runtime_error("A turned away request should not be in flight");
+  }
+
+}
+
+int main() {
+  test::suite suite("drain");
+
+  suite.test(TEST_CASE(test_drain_waits));
+
+  suite.test(TEST_CASE(test_drain_empty));
+
+  suite.test(TEST_CASE(test_drain_closes));
+
+  suite.test(TEST_CASE(test_drain_timeout));
+
+  suite.test(TEST_CASE(test_finish_unknown));
+
+  suite.test(TEST_CASE(test_gate_finishes_after_send));
+
+  suite.test(TEST_CASE(test_gate_flushes));
+
+  suite.test(TEST_CASE(test_gate_turns_away));
+
+  return suite.tear_down();
+}
@@ -0,0 +1,130 @@
+#include "test.h"
+
+#include <sstream>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "tyr/lanes.h"
+
+using namespace valhalla::tyr;
+
+namespace {
+
+  boost::property_tree::ptree to_ptree(const std::string& json) {
+    std::stringstream stream(json);
+    boost::property_tree::ptree pt;
+    boost::property_tree::read_json(stream, pt);
+    return pt;
+  }
+
+  const std::string CONFIG = R"({
+    "loki": {"service": {"proxy": "ipc://loki"}}, "thor": {"service": {"proxy": "ipc://thor"}},
+    "odin": {"service": {"proxy": "ipc://odin"}}, "tyr": {"service": {"proxy": "ipc://tyr"}},
+    "httpd": {"service": {"listen": "tcp://*:8002", "loopback": "ipc://loopback", "lanes": {
+      "regional": {"worker_share": 0.25, "min_distance": 50000},
+      "batch": {"worker_share": 0.25, "min_distance": 500000}
+    }}}
+  })";
+
+  void test_get_lanes() {
+    auto lanes = get_lanes(to_ptree(CONFIG));
+    if(lanes.size() != 3 || lanes[0].name != "default" || lanes[1].name != "regional" || lanes[2].name != "batch")
+      throw std::runtime_error("Wrong lanes");
+    //every lane gets its own proxies but they all share the loopback
+    if(lanes[0].config.get<std::string>("thor.service.proxy") != "ipc://thor_default" ||
+       lanes[2].config.get<std::string>("tyr.service.proxy") != "ipc://tyr_batch" ||
+       lanes[2].config.get<std::string>("httpd.service.loopback") != "ipc://loopback")
+      throw std::runtime_error("Wrong lane endpoints");
+
+    //without extra lanes nothing changes
+    auto single = get_lanes(to_ptree(R"({"loki": {"service": {"proxy": "ipc://loki"}}})"));
+    if(single.size() != 1 || single[0].config.get<std::string>("loki.service.proxy") != "ipc://loki")
+      throw std::runtime_error("Single lane config should be untouched");
+  }
+
+  void test_reserve_workers() {
+    auto lanes = get_lanes(to_ptree(CONFIG));
+    reserve_workers(lanes, 8);
+    if(lanes[0].workers != 4 || lanes[1].workers != 2 || lanes[2].workers != 2)
+      throw std::runtime_error("Expected 4/2/2 workers for 8");
+
+    //2 workers: each lane rounds up to 1 but the default lane has to keep one
+    reserve_workers(lanes, 2);
+    if(lanes[0].workers != 1 || lanes[1].workers + lanes[2].workers != 1)
+      throw std::runtime_error("Expected the default lane to keep one of 2 workers");
+
+    //1 worker: everything goes in the default lane rather than failing
+    reserve_workers(lanes, 1);
+    if(lanes[0].workers != 1 || lanes[1].workers != 0 || lanes[2].workers != 0)
+      throw std::runtime_error("Expected the default lane to get the only worker");
+  }
+
+  void test_classify() {
+    auto lanes = get_lanes(to_ptree(CONFIG));
+    reserve_workers(lanes, 8);
+
+    //a few blocks in new york
+    auto in_town = to_ptree(R"({"locations": [{"lat": 40.744377, "lon": -73.990433}, {"lat": 40.745811, "lon": -73.988075}]})");
+    if(classify(lanes, in_town) != 0)
+      throw std::runtime_error("Short route should be in the default lane");
+    //new york to philadelphia is about 130km
+    auto regional = to_ptree(R"({"locations": [{"lat": 40.7128, "lon": -74.0060}, {"lat": 39.9526, "lon": -75.1652}]})");
+    if(classify(lanes, regional) != 1)
+      throw std::runtime_error("Regional route should be in the regional lane");
+    //new york to los angeles
+    auto cross_country = to_ptree(R"({"locations": [{"lat": 40.7128, "lon": -74.0060}, {"lat": 34.0522, "lon": -118.2437}]})");
+    if(classify(lanes, cross_country) != 2)
+      throw std::runtime_error("Cross country route should be in the batch lane");
+
+    //a hint beats the distance
+    in_town.put("priority", "batch");
+    if(classify(lanes, in_town) != 2)
+      throw std::runtime_error("Priority should pick the batch lane");
+    cross_country.put("priority", "default");
+    if(classify(lanes, cross_country) != 0)
+      throw std::runtime_error("Priority should pick the default lane");
+
+    //lanes without workers are never picked
+    reserve_workers(lanes, 1);
+    if(classify(lanes, in_town) != 0 || classify(lanes, regional) != 0)
+      throw std::runtime_error("Lanes without workers should not get requests");
+  }
+
+  std::string http_request(const std::string& path, const std::string& body) {
+    return "POST " + path + " HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+  }
+
+  void test_classify_raw() {
+    auto lanes = get_lanes(to_ptree(CONFIG));
+    reserve_workers(lanes, 8);
+
+    //the locations come from the body and the priority from the query
+    auto cross_country = http_request("/route", R"({"locations": [{"lat": 40.7128, "lon": -74.0060}, {"lat": 34.0522, "lon": -118.2437}]})");
+    if(classify(lanes, cross_country.data(), cross_country.size(), 65536) != 2)
+      throw std::runtime_error("Cross country route should be in the batch lane");
+    auto hinted = http_request("/route?priority=regional", R"({"locations": []})");
+    if(classify(lanes, hinted.data(), hinted.size(), 65536) != 1)
+      throw std::runtime_error("Priority should pick the regional lane");
+
+    //too big to be worth looking at, or garbage, goes in the default lane
+    if(classify(lanes, cross_country.data(), cross_country.size(), cross_country.size() - 1) != 0)
+      throw std::runtime_error("Requests over the limit should not be classified");
+    std::string garbage("not http at all");
+    if(classify(lanes, garbage.data(), garbage.size(), 65536) != 0)
+      throw std::runtime_error("Unparsable requests should be in the default lane");
+  }
+
+}
+
+int main() {
+  test::suite suite("lanes");
+
+  suite.test(TEST_CASE(test_get_lanes));
+
+  suite.test(TEST_CASE(test_reserve_workers));
+
+  suite.test(TEST_CASE(test_classify));
+
+  suite.test(TEST_CASE(test_classify_raw));
+
+  return suite.tear_down();
+}
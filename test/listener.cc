@@ -0,0 +1,209 @@
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "tyr/listener.h"
+
+using namespace valhalla::tyr;
+
+namespace {
+
+  int connect_to(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(fd == -1 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)))
+      throw std::runtime_error("Could not connect: " + std::string(strerror(errno)));
+    return fd;
+  }
+
+  void send_all(int fd, const std::string& data) {
+    for(size_t sent = 0; sent < data.size();) {
+      auto bytes = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if(bytes <= 0)
+        throw std::runtime_error("Could not send: " + std::string(strerror(errno)));
+      sent += bytes;
+    }
+  }
+
+  std::string receive_all(int fd) {
+    std::string data;
+    char bytes[4096];
+    ssize_t received;
+    while((received = recv(fd, bytes, sizeof(bytes), 0)) > 0)
+      data.append(bytes, received);
+    return data;
+  }
+
+  //send the request, say we are done and read the whole response
+  std::string exchange(int fd, const std::string& request) {
+    send_all(fd, request);
+    shutdown(fd, SHUT_WR);
+    auto response = receive_all(fd);
+    close(fd);
+    return response;
+  }
+
+  //stands in for the http server, answers each connection with its name and whatever it was sent
+  struct backend_t {
+    backend_t(const std::string& name): name(name), port(listener_t::free_port()), stopping(false) {
+      fd = socket(AF_INET, SOCK_STREAM, 0);
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_port = htons(port);
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      if(fd == -1 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) || listen(fd, SOMAXCONN))
+        throw std::runtime_error("Could not start backend: " + std::string(strerror(errno)));
+      thread = std::thread([this]() {
+        pollfd item{this->fd, POLLIN, 0};
+        while(!stopping) {
+          if(poll(&item, 1, 100) <= 0)
+            continue;
+          int connection = accept(this->fd, nullptr, nullptr);
+          if(connection == -1)
+            continue;
+          std::thread([this, connection]() {
+            auto request = receive_all(connection);
+            try { send_all(connection, this->name + ":" + request); } catch(...) {}
+            close(connection);
+          }).detach();
+        }
+      });
+    }
+    ~backend_t() {
+      stopping = true;
+      thread.join();
+      close(fd);
+    }
+    std::string name;
+    uint16_t port;
+    int fd;
+    std::atomic<bool> stopping;
+    std::thread thread;
+  };
+
+  //a listener pumping on its own thread
+  struct running_t {
+    running_t(const std::string& endpoint, uint16_t backend_port):
+      listener(endpoint, backend_port), thread(&listener_t::pump, &listener) {}
+    ~running_t() {
+      listener.stop();
+      thread.join();
+    }
+    listener_t listener;
+    std::thread thread;
+  };
+
+  std::string endpoint(uint16_t port) {
+    return "tcp://127.0.0.1:" + std::to_string(port);
+  }
+
+  void test_pass() {
+    backend_t backend("a");
+    auto port = listener_t::free_port();
+    running_t running(endpoint(port), backend.port);
+    if(exchange(connect_to(port), "hello") != "a:hello")
+      throw std::runtime_error("The backend's response should come back through the listener");
+  }
+
+  void test_large() {
+    //more than fits in the buffers on either side
+    backend_t backend("a");
+    auto port = listener_t::free_port();
+    running_t running(endpoint(port), backend.port);
+    std::string request(4 << 20, 'x');
+    for(size_t i = 0; i < request.size(); i += 997)
+      request[i] = static_cast<char>('a' + i % 26);
+    if(exchange(connect_to(port), request) != "a:" + request)
+      throw std::runtime_error("A large request and response should pass through intact");
+  }
+
+  void test_handoff() {
+    //a replacement binds the same port while the first one is still listening
+    backend_t old_backend("old"), new_backend("new");
+    auto port = listener_t::free_port();
+    std::unique_ptr<running_t> old_listener(new running_t(endpoint(port), old_backend.port));
+    std::unique_ptr<running_t> new_listener;
+    try {
+      new_listener.reset(new running_t(endpoint(port), new_backend.port));
+    }
+    catch(const std::exception& e) {
+      throw std::runtime_error("A second listener should be able to share the port: " + std::string(e.what()));
+    }
+
+    //open some connections, the kernel spreads them over both listeners
+    std::vector<int> open;
+    for(int i = 0; i < 32; ++i) {
+      open.push_back(connect_to(port));
+      send_all(open.back(), "before");
+    }
+    //give the listeners a moment to take them
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    //stop the old one from taking new connections, the ones it has keep going
+    old_listener->listener.close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    size_t old_count = 0;
+    for(auto fd : open) {
+      shutdown(fd, SHUT_WR);
+      auto response = receive_all(fd);
+      close(fd);
+      if(response == "old:before")
+        ++old_count;
+      else if(response != "new:before")
+        throw std::runtime_error("Connections should keep going after the listener is closed");
+    }
+    if(old_count == 0 || old_count == open.size())
+      throw std::runtime_error("Connections should have been spread over both listeners");
+
+    //everything new goes to the replacement
+    for(int i = 0; i < 32; ++i)
+      if(exchange(connect_to(port), "after") != "new:after")
+        throw std::runtime_error("New connections should only go to the listener that is still open");
+
+    //and the port stays usable once the old one is gone for good
+    old_listener.reset();
+    if(exchange(connect_to(port), "last") != "new:last")
+      throw std::runtime_error("The replacement should keep the port once the old one is gone");
+  }
+
+  void test_bad_endpoint() {
+    for(const auto& bad : {"ipc://somewhere", "tcp://localhost", "tcp://*:notaport"}) {
+      try {
+        listener_t listener(bad, 8002);
+      }
+      catch(const std::runtime_error&) {
+        continue;
+      }
+      throw std::runtime_error(std::string("Should not be able to listen on ") + bad);
+    }
+  }
+
+}
+
+int main() {
+  test::suite suite("listener");
+
+  suite.test(TEST_CASE(test_pass));
+
+  suite.test(TEST_CASE(test_large));
+
+  suite.test(TEST_CASE(test_handoff));
+
+  suite.test(TEST_CASE(test_bad_endpoint));
+
+  return suite.tear_down();
+}
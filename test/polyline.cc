@@ -0,0 +1,103 @@
+#include "test.h"
+
+#include <sstream>
+#include <vector>
+#include <limits>
+
+#include "tyr/polyline.h"
+
+using namespace valhalla::tyr;
+
+namespace {
+
+  void test_decode() {
+    //from the osrm example route in new york
+    std::vector<int32_t> coordinates;
+    decode_polyline("ozyulA~p_clCfc@ywApTar@", coordinates);
+    std::vector<int32_t> expected{40744376, -73990432, 40743796, -73989011, 40743451, -73988194};
+    if(coordinates != expected)
+      throw std::runtime_error("Decoded polyline did not match the expected coordinates");
+
+    //should reuse the vector
+    decode_polyline("", coordinates);
+    if(!coordinates.empty())
+      throw std::runtime_error("Empty polyline should have no coordinates");
+  }
+
+  void test_round_trip() {
+    std::vector<int32_t> coordinates{0, 0, -90000000, 180000000, 89999999, -179999999, 1, -1, 1, -1};
+    std::vector<int32_t> decoded;
+    decode_polyline(encode_polyline(coordinates), decoded);
+    if(decoded != coordinates)
+      throw std::runtime_error("Round trip did not give back the original coordinates");
+  }
+
+  void test_malformed() {
+    std::vector<int32_t> coordinates;
+    //a lat without a lon and a value missing its last chunk
+    for(const auto& bad : {std::string("ozyulA"), std::string("ozyulA~p_cl")}) {
+      try {
+        decode_polyline(bad, coordinates);
+        throw std::logic_error("Malformed polyline should have thrown: " + bad);
+      }
+      catch(const std::runtime_error&) { }
+    }
+  }
+
+  void test_extremes() {
+    //nothing checks that these are real lat/lons so the whole int32 range has to work
+    std::vector<int32_t> coordinates;
+    for(int i = 0; i < 50; ++i) {
+      coordinates.push_back(i % 2 ? std::numeric_limits<int32_t>::min() : -2000000000);
+      coordinates.push_back(std::numeric_limits<int32_t>::max());
+    }
+    std::vector<int32_t> decoded;
+    decode_polyline(encode_polyline(coordinates), decoded);
+    if(decoded != coordinates)
+      throw std::runtime_error("Round trip of extreme values did not give back the original coordinates");
+    std::ostringstream stream;
+    write_geojson(decoded, 0, 49, stream);
+    if(stream.str().find("[2147.483647,-2147.483648]") == std::string::npos)
+      throw std::runtime_error("Unexpected geojson for extreme values");
+
+    //deltas which would walk off the end of an int32
+    std::vector<int32_t> big{std::numeric_limits<int32_t>::max(), 0};
+    auto encoded = encode_polyline(big);
+    try {
+      decode_polyline(encoded + encoded, decoded);
+      throw std::logic_error("Out of range polyline should have thrown");
+    }
+    catch(const std::runtime_error&) { }
+  }
+
+  void test_geojson() {
+    std::vector<int32_t> coordinates{40744376, -73990432, 40743744, -73988017, -5, 120000000};
+    std::ostringstream stream;
+    write_geojson(coordinates, 0, 2, stream);
+    if(stream.str() != "{\"type\":\"LineString\",\"coordinates\":[[-73.990432,40.744376],[-73.988017,40.743744],[120.000000,-0.000005]]}")
+      throw std::runtime_error("Unexpected geojson: " + stream.str());
+
+    //a sub range of the points like a maneuver would use
+    stream.str("");
+    write_geojson(coordinates, 1, 1, stream);
+    if(stream.str() != "{\"type\":\"LineString\",\"coordinates\":[[-73.988017,40.743744]]}")
+      throw std::runtime_error("Unexpected geojson: " + stream.str());
+  }
+
+}
+
+int main() {
+  test::suite suite("polyline");
+
+  suite.test(TEST_CASE(test_decode));
+
+  suite.test(TEST_CASE(test_round_trip));
+
+  suite.test(TEST_CASE(test_malformed));
+
+  suite.test(TEST_CASE(test_extremes));
+
+  suite.test(TEST_CASE(test_geojson));
+
+  return suite.tear_down();
+}
@@ -0,0 +1,106 @@
+#include "test.h"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include "tyr/profiler.h"
+#include "tyr/alloc_hook.h"
+
+using namespace valhalla::tyr;
+
+namespace {
+
+  void test_allocations() {
+    //this test links the alloc hook so we should be able to count
+    profiler_t profiler;
+    profiler.begin(phase_t::SERIALIZE);
+    std::vector<std::unique_ptr<int> > ints;
+    for(int i = 0; i < 10; ++i)
+      ints.emplace_back(new int(i));
+    auto sample = profiler.end();
+    if(!profiler.allocations_available())
+      throw std::runtime_error("The alloc hook should have been found");
+    //the ints plus at least one growth of the vector
+    if(sample.allocations < 11)
+      throw std::runtime_error("Expected at least 11 allocations but got " + std::to_string(sample.allocations));
+
+    //shouldnt count anything when we arent measuring
+    auto before = valhalla_tyr_alloc_hook_count();
+    std::unique_ptr<int> uncounted(new int(5));
+    if(valhalla_tyr_alloc_hook_count() != before)
+      throw std::runtime_error("Allocations should not be counted outside of a phase");
+  }
+
+  void test_aggregate() {
+    //this should work whether or not this machine gives us perf events
+    profiler_t profiler;
+    for(int i = 0; i < 3; ++i) {
+      profiler.begin(phase_t::PARSE);
+      profiler.end();
+    }
+    profiler.begin(phase_t::RESPONSE);
+    profiler.cancel();
+    if(profiler.measuring())
+      throw std::runtime_error("Cancelled phase should not be measuring");
+    if(profiler.aggregate(phase_t::PARSE).count != 3)
+      throw std::runtime_error("Expected 3 parse phases");
+    if(profiler.aggregate(phase_t::RESPONSE).count != 0)
+      throw std::runtime_error("Cancelled phase should not be aggregated");
+    if(profiler.summary().find("parse: requests=3") == std::string::npos)
+      throw std::runtime_error("Summary is missing the parse phase");
+    profiler.reset();
+    if(profiler.aggregate(phase_t::PARSE).count != 0)
+      throw std::runtime_error("Reset should clear the totals");
+  }
+
+  void test_totals() {
+    //each thread has its own profiler and they all add up in one place
+    profile_totals_t totals;
+    std::atomic<bool> reset(true);
+    std::vector<std::thread> workers;
+    for(int i = 0; i < 4; ++i) {
+      workers.emplace_back([&totals, &reset]() {
+        profiler_t profiler;
+        for(int j = 0; j < 5; ++j) {
+          profiler.begin(phase_t::SERIALIZE);
+          profiler.end();
+        }
+        totals.merge(profiler);
+        if(profiler.aggregate(phase_t::SERIALIZE).count != 0)
+          reset = false;
+      });
+    }
+    for(auto& worker : workers)
+      worker.join();
+    if(!reset)
+      throw std::runtime_error("Merging should reset the profiler");
+    auto serialize = totals.aggregate(phase_t::SERIALIZE);
+    if(serialize.count != 20)
+      throw std::runtime_error("Expected 20 serialize phases from all the workers");
+    if(serialize.counted > serialize.count)
+      throw std::runtime_error("Cant have counters for more phases than we measured");
+
+    //one summary for all of them once the interval passes and then we start over
+    if(!totals.summary(std::chrono::hours(1)).empty())
+      throw std::runtime_error("Summary should wait for the interval");
+    if(totals.summary(std::chrono::seconds(0)).find("serialize: requests=20") == std::string::npos)
+      throw std::runtime_error("Summary is missing the serialize phase");
+    if(totals.aggregate(phase_t::SERIALIZE).count != 0)
+      throw std::runtime_error("Summary should start the totals over");
+  }
+
+}
+
+int main() {
+  test::suite suite("profiler");
+
+  suite.test(TEST_CASE(test_allocations));
+
+  suite.test(TEST_CASE(test_aggregate));
+
+  suite.test(TEST_CASE(test_totals));
+
+  return suite.tear_down();
+}
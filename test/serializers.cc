@@ -1,13 +1,135 @@
 #include "test.h"
 
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "tyr/serializers.h"
+#include "tyr/polyline.h"
+
+using namespace valhalla;
+using namespace valhalla::tyr;
+
 namespace {
 
-//TODO: test serialization of directions_options trip_directions objects
+  //a few blocks in new york with one maneuver per edge
+  const std::vector<int32_t> shape{40744376, -73990432, 40743796, -73989011, 40743451, -73988194, 40744100, -73987700};
+
+  odin::TripDirections trip_directions() {
+    odin::TripDirections trip;
+    //the name looks like what we used to splice geometry in with, it has to come out untouched
+    for(const auto& name : {std::string("__tyr_geojson_0__"), std::string("end\",\"shape\":{}")}) {
+      auto* location = trip.add_location();
+      location->mutable_ll()->set_lat(40.744376);
+      location->mutable_ll()->set_lng(-73.990432);
+      location->set_name(name);
+    }
+    std::vector<std::pair<uint32_t, uint32_t> > indices{{0, 2}, {2, 3}, {3, 3}};
+    for(const auto& index : indices) {
+      auto* maneuver = trip.add_maneuver();
+      maneuver->set_type(odin::TripDirections_Maneuver_Type_kContinue);
+      maneuver->set_text_instruction("Continue on __tyr_geojson_1__.");
+      maneuver->add_street_name("__tyr_geojson_1__");
+      maneuver->set_begin_shape_index(index.first);
+      maneuver->set_end_shape_index(index.second);
+    }
+    trip.mutable_summary()->set_time(60);
+    trip.mutable_summary()->set_length(.25);
+    trip.set_shape(encode_polyline(shape));
+    return trip;
+  }
+
+  boost::property_tree::ptree serialize(shape_format_t shape_format) {
+    odin::DirectionsOptions options;
+    options.set_units(odin::DirectionsOptions::kKilometers);
+    std::ostringstream stream;
+    valhalla_serializers::serialize(options, trip_directions(), shape_format, stream);
+    //has to be valid json
+    std::stringstream json(stream.str());
+    boost::property_tree::ptree response;
+    boost::property_tree::read_json(json, response);
+    return response;
+  }
+
+  //the [lon, lat] pairs in a geojson linestring
+  std::vector<int32_t> points(const boost::property_tree::ptree& geometry) {
+    if(geometry.get<std::string>("type") != "LineString")
+      throw std::runtime_error("Geometry should be a LineString");
+    std::vector<int32_t> coordinates;
+    for(const auto& point : geometry.get_child("coordinates")) {
+      std::vector<int32_t> lon_lat;
+      for(const auto& value : point.second)
+        lon_lat.push_back(static_cast<int32_t>(std::llround(value.second.get_value<double>() * POLYLINE_PRECISION)));
+      coordinates.push_back(lon_lat.at(1));
+      coordinates.push_back(lon_lat.at(0));
+    }
+    return coordinates;
+  }
+
+  void check_locations(const boost::property_tree::ptree& trip) {
+    std::vector<std::string> names;
+    for(const auto& location : trip.get_child("locations"))
+      names.push_back(location.second.get<std::string>("name"));
+    if(names != std::vector<std::string>{"__tyr_geojson_0__", "end\",\"shape\":{}"})
+      throw std::runtime_error("Location names should be written as is");
+    auto& maneuvers = trip.get_child("legs").front().second.get_child("maneuvers");
+    for(const auto& maneuver : maneuvers)
+      if(maneuver.second.get<std::string>("street_names..") != "__tyr_geojson_1__" ||
+         maneuver.second.get<std::string>("instruction") != "Continue on __tyr_geojson_1__.")
+        throw std::runtime_error("Maneuver text should be written as is");
+  }
+
+  void test_polyline() {
+    auto trip = serialize(shape_format_t::POLYLINE).get_child("trip");
+    check_locations(trip);
+    auto& leg = trip.get_child("legs").front().second;
+    if(leg.get<std::string>("shape") != encode_polyline(shape))
+      throw std::runtime_error("Leg shape should be the encoded polyline");
+    for(const auto& maneuver : leg.get_child("maneuvers"))
+      if(maneuver.second.count("shape"))
+        throw std::runtime_error("Maneuvers should not have a shape");
+  }
+
+  void test_geojson() {
+    auto trip = serialize(shape_format_t::GEOJSON).get_child("trip");
+    check_locations(trip);
+    auto& leg = trip.get_child("legs").front().second;
+    if(points(leg.get_child("shape")) != shape)
+      throw std::runtime_error("Leg shape should be the whole route");
+    for(const auto& maneuver : leg.get_child("maneuvers"))
+      if(maneuver.second.count("shape"))
+        throw std::runtime_error("Maneuvers should not have a shape");
+  }
+
+  void test_geojson_maneuvers() {
+    auto trip = serialize(shape_format_t::GEOJSON_MANEUVERS).get_child("trip");
+    check_locations(trip);
+    auto& leg = trip.get_child("legs").front().second;
+    if(points(leg.get_child("shape")) != shape)
+      throw std::runtime_error("Leg shape should be the whole route");
+    //each maneuver gets the points from its begin to its end shape index inclusive
+    std::vector<std::vector<int32_t> > expected{
+      {shape.begin(), shape.begin() + 6}, {shape.begin() + 4, shape.end()}, {shape.begin() + 6, shape.end()}
+    };
+    size_t i = 0;
+    for(const auto& maneuver : leg.get_child("maneuvers"))
+      if(points(maneuver.second.get_child("shape")) != expected.at(i++))
+        throw std::runtime_error("Maneuver shape should be its part of the route");
+    if(i != expected.size())
+      throw std::runtime_error("Wrong number of maneuvers");
+  }
 
 }
 
 int main() {
-  test::suite suite("serailizers");
+  test::suite suite("serializers");
+
+  suite.test(TEST_CASE(test_polyline));
+  suite.test(TEST_CASE(test_geojson));
+  suite.test(TEST_CASE(test_geojson_maneuvers));
 
   return suite.tear_down();
 }
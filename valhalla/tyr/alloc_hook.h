@@ -0,0 +1,32 @@
+#ifndef __VALHALLA_TYR_ALLOC_HOOK_H__
+#define __VALHALLA_TYR_ALLOC_HOOK_H__
+
+#include <cstdint>
+
+/**
+ * Counts calls to the global operator new per thread. This lives in its own
+ * library, libvalhalla_tyr_alloc_hook, which is never linked into libvalhalla_tyr
+ * so that nothing pays for it unless it is asked for. To use it either link the
+ * shared library in front of everything else or preload it:
+ *
+ *   LD_PRELOAD=libvalhalla_tyr_alloc_hook.so tyr_simple_service conf/valhalla.json
+ *
+ * It must come before any other allocator which replaces operator new (tcmalloc
+ * for example) in the preload list or it will never be called. The profiler
+ * finds these with dlsym(RTLD_DEFAULT) so when the hook isnt loaded allocations
+ * are simply reported as unavailable. dlsym only sees symbols which are exported
+ * dynamically, so if you link the hook statically into an executable (say with
+ * --disable-shared) you also have to link with -rdynamic (-export-dynamic with
+ * libtool) or it wont be found.
+ */
+extern "C" {
+
+  //turn counting on or off for the calling thread
+  void valhalla_tyr_alloc_hook_arm(bool enabled);
+
+  //number of allocations made on the calling thread while it was armed
+  uint64_t valhalla_tyr_alloc_hook_count();
+
+}
+
+#endif //__VALHALLA_TYR_ALLOC_HOOK_H__
@@ -0,0 +1,99 @@
+#ifndef __VALHALLA_TYR_DRAIN_H__
+#define __VALHALLA_TYR_DRAIN_H__
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <unordered_set>
+#include <boost/property_tree/ptree.hpp>
+
+#include <prime_server/prime_server.hpp>
+
+namespace valhalla {
+  namespace tyr {
+
+    /**
+     * Blocks SIGINT and SIGTERM on the calling thread. Call this in main before
+     * starting any other threads (including the ones a zmq context starts) so
+     * that they all inherit the mask and only wait_for_shutdown sees them.
+     */
+    void block_shutdown_signals();
+
+    //blocks until SIGINT or SIGTERM arrives and returns which one it was
+    int wait_for_shutdown();
+
+    /**
+     * Keeps track of the requests let into a process through its entry point,
+     * by the id the http server gave them. Once it's closed nothing else gets
+     * in and draining waits for the ones already admitted to finish.
+     */
+    class intake_t {
+     public:
+      intake_t();
+      intake_t(const intake_t&) = delete;
+      intake_t& operator=(const intake_t&) = delete;
+
+      //lets a request in unless we are closed
+      bool admit(uint64_t id);
+      //marks a request as finished, ones we didnt admit are ignored
+      void finish(uint64_t id);
+      //how many requests are in flight
+      size_t in_flight() const;
+
+      //close the intake and wait for the requests in flight, false if we hit the timeout first
+      bool drain(const std::chrono::milliseconds& timeout);
+      //same as above but with the timeout (in seconds) from tyr.service.drain.timeout
+      bool drain(const boost::property_tree::ptree& config);
+
+     protected:
+      mutable std::mutex mutex;
+      std::unordered_set<uint64_t> admitted;
+      bool closed;
+    };
+
+    /**
+     * Sits between the http server and the first stage of the pipeline. Each
+     * request it forwards is admitted to the intake. Responses come back from
+     * the workers through the loopback, which we relay on to the server, and
+     * a request is only finished once its response has been sent on. Once the
+     * intake is closed new requests are answered with a 503 right away and
+     * never enter the pipeline. With no upstream endpoint only the responses
+     * pass through, for when something else admits the requests.
+     *
+     * The gate has its own zmq context. When it's stopped it closes its sockets
+     * and waits up to linger for the last responses to actually leave, which
+     * the process cant do for the shared context since the workers never close
+     * their sockets.
+     */
+    class gate_t {
+     public:
+      gate_t(const std::string& upstream_endpoint, const std::string& downstream_endpoint,
+        const std::string& loopback_endpoint, const std::string& server_loopback_endpoint,
+        intake_t& intake, const std::chrono::milliseconds& linger);
+      //pass requests and responses until stopped, then flush and close everything
+      void pass();
+      //have pass return, safe to call from any thread
+      void stop();
+     protected:
+      void request();
+      void response();
+
+      zmq::context_t context;
+      zmq::socket_t upstream;
+      zmq::socket_t downstream;
+      zmq::socket_t loopback;
+      zmq::socket_t server_loopback;
+      intake_t& intake;
+      bool gating;
+      std::atomic<bool> stopping;
+    };
+
+    //how long to give the last responses to get out, from tyr.service.drain.grace (in seconds)
+    std::chrono::milliseconds drain_grace(const boost::property_tree::ptree& config);
+
+  }
+}
+
+#endif //__VALHALLA_TYR_DRAIN_H__
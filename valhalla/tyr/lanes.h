@@ -0,0 +1,90 @@
+#ifndef __VALHALLA_TYR_LANES_H__
+#define __VALHALLA_TYR_LANES_H__
+
+#include <string>
+#include <vector>
+#include <list>
+#include <boost/property_tree/ptree.hpp>
+
+#include <prime_server/prime_server.hpp>
+
+namespace valhalla {
+  namespace tyr {
+
+    /**
+     * A lane is a complete copy of the pipeline: proxies and workers for every
+     * stage. Since nothing is shared between lanes, a burst of long routes in
+     * one lane cant sit in front of short routes in another, they only compete
+     * for cpu with the workers reserved for them.
+     */
+    struct lane_t {
+      std::string name;
+      //share of the workers at each stage this lane asked for
+      float worker_share;
+      //straight line distance in meters at or beyond which requests use this lane,
+      //0 means the lane is only used when a request asks for it by name
+      float min_distance;
+      //how many workers per stage the lane actually got
+      size_t workers;
+      //the config the lane's workers run with, where the endpoints are unique to the lane
+      boost::property_tree::ptree config;
+    };
+
+    /**
+     * Get the lanes from httpd.service.lanes. The default lane is always first
+     * and if there are no other lanes its config is left exactly as it was.
+     */
+    std::vector<lane_t> get_lanes(const boost::property_tree::ptree& config);
+
+    /**
+     * Split up the workers for each stage between the lanes. The default lane
+     * always keeps at least one. When there arent enough to go around, lanes
+     * which end up with none get no traffic and it goes to the default lane.
+     */
+    void reserve_workers(std::vector<lane_t>& lanes, size_t worker_concurrency);
+
+    /**
+     * Pick the lane for a request. A priority naming a lane wins, otherwise the
+     * straight line distance through the locations picks the lane with the
+     * largest min_distance it reaches. Anything else goes in the default lane.
+     */
+    size_t classify(const std::vector<lane_t>& lanes, const boost::property_tree::ptree& request);
+
+    /**
+     * Same as above but straight from the raw http request. Parsing the request
+     * and its json costs time in front of every lane, so requests bigger than
+     * max_bytes arent looked at and go in the default lane, as does anything
+     * we cant parse.
+     */
+    size_t classify(const std::vector<lane_t>& lanes, const char* request, size_t size, size_t max_bytes);
+
+    /**
+     * The front stage of the pipeline when there is more than one lane. It sits
+     * where the first stage's proxy would, takes each request from the http
+     * server, classifies it and forwards it to the proxy of the lane it belongs
+     * in, which then schedules it on that lane's workers.
+     *
+     * Every request passes through here before any lane sees it. Receiving and
+     * handing requests off is cheap and done on one thread, the classifying is
+     * spread over httpd.service.router.threads threads (2 by default) and only
+     * done for requests up to httpd.service.router.max_bytes (64k by default).
+     */
+    class router_t {
+     public:
+      router_t(zmq::context_t& context, const std::string& upstream_endpoint, const std::vector<lane_t>& lanes);
+      void route();
+     protected:
+      void classify_jobs();
+
+      zmq::context_t& context;
+      zmq::socket_t upstream;
+      zmq::socket_t classifiers;
+      std::vector<lane_t> lanes;
+      size_t threads;
+      size_t max_bytes;
+    };
+
+  }
+}
+
+#endif //__VALHALLA_TYR_LANES_H__
@@ -0,0 +1,64 @@
+#ifndef __VALHALLA_TYR_LISTENER_H__
+#define __VALHALLA_TYR_LISTENER_H__
+
+#include <atomic>
+#include <string>
+#include <list>
+#include <cstdint>
+
+namespace valhalla {
+  namespace tyr {
+
+    /**
+     * Listens on the public tcp endpoint with SO_REUSEPORT so that a replacement
+     * process can bind the same port and take new connections while this one
+     * drains. The http server cant share its socket like that so it listens on a
+     * private port on the loopback interface instead, and we pass the bytes of
+     * each connection back and forth between the client and the server.
+     */
+    class listener_t {
+     public:
+      //binds the endpoint, tcp://host:port where host can be *
+      listener_t(const std::string& endpoint, uint16_t backend_port);
+      listener_t(const listener_t&) = delete;
+      listener_t& operator=(const listener_t&) = delete;
+      ~listener_t();
+
+      //accept connections and pass their bytes along until stopped
+      void pump();
+      //stop accepting, connections we already have keep going. safe to call from any thread
+      void close();
+      //drop all connections and have pump return. safe to call from any thread
+      void stop();
+
+      //a port on the loopback interface that nothing was listening on just now
+      static uint16_t free_port();
+
+     protected:
+      struct connection_t {
+        int client;
+        int backend;
+        //whether each side is still sending
+        bool client_open;
+        bool backend_open;
+        //whether we've told each side the other is done sending
+        bool client_shut;
+        bool backend_shut;
+        std::string to_client;
+        std::string to_backend;
+      };
+
+      void accept();
+      void close_listening();
+
+      int listening;
+      uint16_t backend_port;
+      std::list<connection_t> connections;
+      std::atomic<bool> closing;
+      std::atomic<bool> stopping;
+    };
+
+  }
+}
+
+#endif //__VALHALLA_TYR_LISTENER_H__
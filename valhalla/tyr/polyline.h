@@ -0,0 +1,36 @@
+#ifndef __VALHALLA_TYR_POLYLINE_H__
+#define __VALHALLA_TYR_POLYLINE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace valhalla {
+  namespace tyr {
+
+    //trip shapes are encoded with 6 digits of precision
+    constexpr int32_t POLYLINE_PRECISION = 1000000;
+
+    /**
+     * Decode an encoded polyline into fixed point coordinates (in units of
+     * 1/POLYLINE_PRECISION degrees) stored flat as lat,lon,lat,lon... The
+     * output is cleared first but its capacity is reused so decoding many
+     * shapes with the same vector doesnt allocate. Throws on malformed input.
+     */
+    void decode_polyline(const std::string& encoded, std::vector<int32_t>& coordinates);
+
+    //the inverse of the above, mostly useful for testing
+    std::string encode_polyline(const std::vector<int32_t>& coordinates);
+
+    /**
+     * Write the points [begin, end] of decoded coordinates as a GeoJSON
+     * LineString, ie. {"type":"LineString","coordinates":[[lon,lat],...]}
+     * straight to the stream without building up any json objects
+     */
+    void write_geojson(const std::vector<int32_t>& coordinates, size_t begin, size_t end, std::ostream& stream);
+
+  }
+}
+
+#endif //__VALHALLA_TYR_POLYLINE_H__
@@ -0,0 +1,132 @@
+#ifndef __VALHALLA_TYR_PROFILER_H__
+#define __VALHALLA_TYR_PROFILER_H__
+
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <array>
+#include <mutex>
+
+namespace valhalla {
+  namespace tyr {
+
+    //the phases of a tyr request that we can profile
+    enum class phase_t : size_t { PARSE = 0, SERIALIZE = 1, RESPONSE = 2 };
+    constexpr size_t PHASE_COUNT = 3;
+
+    //what we measure for a given phase, counters not supported by the
+    //kernel/hardware are left at zero and flagged in the profiler
+    struct sample_t {
+      uint64_t cycles;
+      uint64_t instructions;
+      uint64_t cache_misses;
+      uint64_t branch_misses;
+      uint64_t allocations;
+      uint64_t nanoseconds;
+      sample_t& operator+=(const sample_t& other);
+    };
+
+    //running totals for a phase over many requests
+    struct aggregate_t {
+      uint64_t count;
+      //how many of those the hardware counters were actually scheduled for,
+      //the counter totals only include these
+      uint64_t counted;
+      sample_t total;
+    };
+
+    /**
+     * Measures hardware performance counters (via perf_event_open) and heap
+     * allocations for the calling thread around the phases of a request. If
+     * perf events are unavailable (non linux, kernel.perf_event_paranoid, no
+     * pmu in a vm/container etc) we still measure wall time. Allocations are
+     * only counted when the alloc hook library is loaded, see alloc_hook.h
+     *
+     * Counters are per thread so a profiler must only be used from the thread
+     * which first calls begin() on it, which is the case for a tyr worker.
+     */
+    class profiler_t {
+     public:
+      profiler_t();
+      ~profiler_t();
+      profiler_t(const profiler_t&) = delete;
+      profiler_t& operator=(const profiler_t&) = delete;
+
+      //start measuring a phase
+      void begin(phase_t phase);
+      //stop measuring the current phase and add it to the running totals
+      const sample_t& end();
+      //stop measuring the current phase without recording it
+      void cancel();
+      //whether we are between a begin() and an end()
+      bool measuring() const;
+
+      //the totals per phase since the last reset
+      const aggregate_t& aggregate(phase_t phase) const;
+      //forget all the totals
+      void reset();
+      //single line summary of the per phase totals, suitable for logging
+      std::string summary() const;
+
+      //whether or not any of the hardware counters could be opened
+      bool hardware_available() const;
+      //whether or not the alloc hook is loaded so we can count allocations
+      bool allocations_available() const;
+
+     protected:
+      //raw group counts along with how long the group was enabled and actually on the pmu
+      struct counters_t {
+        std::array<uint64_t, 4> values;
+        uint64_t enabled;
+        uint64_t running;
+      };
+
+      void open();
+      void read(counters_t& counters) const;
+      uint64_t allocations() const;
+
+      bool opened;
+      void (*arm_hook)(bool);
+      uint64_t (*hook_count)();
+      bool running;
+      std::array<int, 4> fds;
+      //where each event is in the group read, -1 when it couldnt be opened
+      std::array<int, 4> slots;
+      int leader;
+      phase_t current;
+      counters_t counters_start;
+      uint64_t allocations_start;
+      std::chrono::steady_clock::time_point time_start;
+      sample_t last;
+      std::array<aggregate_t, PHASE_COUNT> aggregates;
+    };
+
+    /**
+     * The per phase totals of all the profilers in a process. The counters are
+     * per thread so each worker has its own profiler, they add to these so that
+     * we log one set of results for the process rather than one per worker.
+     */
+    class profile_totals_t {
+     public:
+      profile_totals_t();
+
+      //add the profiler's totals to ours and reset it
+      void merge(profiler_t& profiler);
+      //the totals per phase since the last summary
+      aggregate_t aggregate(phase_t phase);
+      //if at least interval has passed since the last summary, a summary like the
+      //profiler's and start the totals over, otherwise an empty string
+      std::string summary(const std::chrono::steady_clock::duration& interval);
+
+     protected:
+      std::mutex mutex;
+      std::array<aggregate_t, PHASE_COUNT> aggregates;
+      bool hardware;
+      bool allocations;
+      std::chrono::steady_clock::time_point last_summary;
+    };
+
+  }
+}
+
+#endif //__VALHALLA_TYR_PROFILER_H__
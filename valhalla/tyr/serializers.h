@@ -0,0 +1,34 @@
+#ifndef __VALHALLA_TYR_SERIALIZERS_H__
+#define __VALHALLA_TYR_SERIALIZERS_H__
+
+#include <sstream>
+
+#include <valhalla/proto/tripdirections.pb.h>
+#include <valhalla/proto/directions_options.pb.h>
+
+namespace valhalla {
+  namespace tyr {
+
+    //how the route geometry should be returned
+    enum class shape_format_t { POLYLINE, GEOJSON, GEOJSON_MANEUVERS };
+
+    namespace osrm_serializers {
+      //osrm compatible json, per maneuver geometry isnt supported
+      void serialize(const valhalla::odin::DirectionsOptions& directions_options,
+        const valhalla::odin::TripDirections& trip_directions,
+        shape_format_t shape_format,
+        std::ostringstream& stream);
+    }
+
+    namespace valhalla_serializers {
+      //valhalla's own json
+      void serialize(const valhalla::odin::DirectionsOptions& directions_options,
+        const valhalla::odin::TripDirections& trip_directions,
+        shape_format_t shape_format,
+        std::ostringstream& stream);
+    }
+
+  }
+}
+
+#endif //__VALHALLA_TYR_SERIALIZERS_H__
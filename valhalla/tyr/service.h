@@ -3,11 +3,16 @@
 
 #include <boost/property_tree/ptree.hpp>
 
+#include <valhalla/tyr/drain.h>
+
 namespace valhalla {
   namespace tyr {
 
     void run_service(const boost::property_tree::ptree& config);
 
+    //for when tyr is the way into the process, jobs are turned away once the intake is closed
+    void run_service(const boost::property_tree::ptree& config, intake_t& intake);
+
   }
 }
 